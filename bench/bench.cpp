@@ -0,0 +1,251 @@
+/* Microbenchmarks for the renderer's building blocks, on synthetic data.
+Build the qGBABench project in Release and run it from a console.
+None of this needs SDL or a ROM. */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../src/simd.hpp"
+#include "../src/tilecache.hpp"
+#include "../src/renderer.hpp"
+
+typedef std::chrono::steady_clock benchClock;
+
+static double nanosecondsSince(benchClock::time_point start, uint64_t count)
+{
+	return std::chrono::duration<double, std::nano>(benchClock::now() - start).count() / (double)count;
+}
+
+// What the renderer did before the cache: split a 4bpp row into one byte per pixel on every read
+static uint64_t decodeRowDirect(const uint8_t* vram, uint32_t tileAddr, int row)
+{
+	uint64_t pixels = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uint8_t source = vram[tileAddr + (row * 4) + i];
+		pixels |= (uint64_t)(source & 0xF) << (i * 16);
+		pixels |= (uint64_t)(source >> 4) << ((i * 16) + 8);
+	}
+	return pixels;
+}
+
+/* Reads rows of random BG tiles, the way a frame of text BGs does, after dirtying
+some tiles each frame like a game streaming in new graphics would.
+Prints the time per row against decoding straight from VRAM, and the hit rate. */
+static void benchTileCache()
+{
+	constexpr int frames = 2000;
+	constexpr int rowsPerFrame = 4 * 31 * 160; // 4 BGs, 31 tiles across, 160 lines
+	std::vector<uint8_t> vram(0x18000);
+	std::mt19937 random(1);
+	for (uint8_t& byte : vram)
+	{
+		byte = (uint8_t)random();
+	}
+	std::vector<uint32_t> rowReads(rowsPerFrame);
+	for (uint32_t& read : rowReads)
+	{
+		read = ((random() % 2048) * 32) | (random() % 8); // A tile in BG VRAM, and a row
+	}
+
+	printf("Tile cache (%d row reads per frame)\n", rowsPerFrame);
+	uint64_t checksum = 0;
+	benchClock::time_point start = benchClock::now();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (uint32_t read : rowReads)
+		{
+			checksum += decodeRowDirect(vram.data(), read & ~0x1F, read & 0x7);
+		}
+	}
+	printf("  direct decode:            %6.2f ns/row\n", nanosecondsSince(start, (uint64_t)frames * rowsPerFrame));
+
+	const int dirtyTilesPerFrame[] = { 0, 16, 256 };
+	for (int dirtyTiles : dirtyTilesPerFrame)
+	{
+		tileCache* Tiles = new tileCache(vram.data());
+		tileCacheStats stats = { 0, 0 };
+		start = benchClock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < dirtyTiles; i++)
+			{
+				Tiles->invalidate((random() % 2048) * 32, 32);
+			}
+			for (uint32_t read : rowReads)
+			{
+				checksum += Tiles->getRow(read & ~0x1F, read & 0x7, stats);
+			}
+		}
+		double time = nanosecondsSince(start, (uint64_t)frames * rowsPerFrame);
+		printf("  cache, %3d dirty/frame:    %6.2f ns/row, %llu hits, %llu misses (%.3f%% hits), %llu decodes\n", dirtyTiles, time,
+			(unsigned long long)stats.hits, (unsigned long long)stats.misses, 100.0 * stats.hits / (stats.hits + stats.misses),
+			(unsigned long long)Tiles->getDecodes());
+		delete Tiles;
+	}
+	printf("  (checksum %llx)\n\n", (unsigned long long)checksum);
+}
+
+constexpr int lineWidth = 240;
+constexpr int layerCount = 6; // 4 BGs and 2 OBJ priorities
+
+// Random line buffers with about a third of the pixels transparent, and random settings
+struct kernelInputs
+{
+	uint16_t layers[layerCount][lineWidth];
+	uint16_t layerBits[layerCount];
+	uint16_t windowMask[lineWidth];
+	layerTargets targets; // BGR555 colours and layer bits for blend
+	blendSettings settings;
+	uint16_t mosaicLine[lineWidth + 8];
+	int mosaicSize;
+
+	void randomise(std::mt19937& random)
+	{
+		for (int i = 0; i < layerCount; i++)
+		{
+			for (int x = 0; x < lineWidth; x++)
+			{
+				layers[i][x] = (random() % 3 == 0) ? 0 : (uint16_t)random();
+			}
+			layerBits[i] = (i < 4) ? 1 << i : 0x10;
+		}
+		for (int x = 0; x < lineWidth; x++)
+		{
+			windowMask[x] = random() & 0x3F;
+			targets.top[x] = random() & 0x7FFF;
+			targets.second[x] = random() & 0x7FFF;
+			targets.topLayer[x] = random() & 0x7F; // Includes the semi-transparent OBJ bit
+			targets.secondLayer[x] = random() & 0x3F;
+			mosaicLine[x] = (uint16_t)random();
+		}
+		settings.firstTargets = random() & 0x3F;
+		settings.secondTargets = random() & 0x3F;
+		int effect = random() % 4;
+		settings.alpha = effect == 1;
+		settings.brightness = effect >= 2;
+		settings.brighten = effect == 2;
+		settings.firstWeight = random() % 17;
+		settings.secondWeight = random() % 17;
+		settings.brightnessWeight = random() % 17;
+		mosaicSize = (random() % 16) + 1;
+	}
+};
+
+static int countDifferences(const uint16_t* a, const uint16_t* b, int length)
+{
+	int differences = 0;
+	for (int i = 0; i < length; i++)
+	{
+		differences += a[i] != b[i];
+	}
+	return differences;
+}
+
+/* Checks that each SIMD level's merge, blend and mosaic give exactly what the scalar versions do,
+then times the merges and the blend on a line. Returns the number of mismatched pixels. */
+static int benchKernels()
+{
+	constexpr int checks = 20000;
+	constexpr int timedLines = 200000;
+	const char* levelNames[] = { "scalar", "SSE2", "AVX2" };
+	std::vector<simdLevel> levels = { simdLevel::Scalar };
+	if (cpuFeatures::hasSSE2())
+	{
+		levels.push_back(simdLevel::SSE2);
+	}
+	if (cpuFeatures::hasAVX2())
+	{
+		levels.push_back(simdLevel::AVX2);
+	}
+	rendererKernels scalar = renderer::getKernels(simdLevel::Scalar);
+	kernelInputs* inputs = new kernelInputs;
+	layerTargets* expectedTargets = new layerTargets;
+	layerTargets* actualTargets = new layerTargets;
+	std::mt19937 random(2);
+	int totalDifferences = 0;
+
+	printf("Line kernels (%d layers, %d random lines checked against scalar)\n", layerCount, checks);
+	for (simdLevel level : levels)
+	{
+		rendererKernels kernels = renderer::getKernels(level);
+		const uint16_t* layers[layerCount];
+		for (int i = 0; i < layerCount; i++)
+		{
+			layers[i] = inputs->layers[i];
+		}
+		int differences = 0;
+		for (int check = 0; check < checks; check++)
+		{
+			inputs->randomise(random);
+			uint16_t expected[lineWidth + 8];
+			uint16_t actual[lineWidth + 8];
+			int count = (check % layerCount) + 1;
+
+			scalar.merge(layers, count, expected, lineWidth);
+			kernels.merge(layers, count, actual, lineWidth);
+			differences += countDifferences(expected, actual, lineWidth);
+
+			scalar.mergeTargets(layers, inputs->layerBits, count, inputs->windowMask, *expectedTargets, lineWidth);
+			kernels.mergeTargets(layers, inputs->layerBits, count, inputs->windowMask, *actualTargets, lineWidth);
+			differences += countDifferences((const uint16_t*)expectedTargets, (const uint16_t*)actualTargets, sizeof(layerTargets) / 2);
+
+			scalar.blend(inputs->targets, inputs->settings, expected, lineWidth);
+			kernels.blend(inputs->targets, inputs->settings, actual, lineWidth);
+			differences += countDifferences(expected, actual, lineWidth);
+
+			memcpy(expected, inputs->mosaicLine, sizeof(inputs->mosaicLine));
+			memcpy(actual, inputs->mosaicLine, sizeof(inputs->mosaicLine));
+			scalar.mosaic(expected, inputs->mosaicSize, lineWidth);
+			kernels.mosaic(actual, inputs->mosaicSize, lineWidth);
+			differences += countDifferences(expected, actual, lineWidth);
+		}
+		totalDifferences += differences;
+
+		uint16_t out[lineWidth];
+		uint64_t checksum = 0;
+		benchClock::time_point start = benchClock::now();
+		for (int line = 0; line < timedLines; line++)
+		{
+			kernels.merge(layers, layerCount, out, lineWidth);
+			checksum += out[line % lineWidth];
+		}
+		double mergeTime = nanosecondsSince(start, timedLines);
+		start = benchClock::now();
+		for (int line = 0; line < timedLines; line++)
+		{
+			kernels.mergeTargets(layers, inputs->layerBits, layerCount, inputs->windowMask, *actualTargets, lineWidth);
+			checksum += actualTargets->second[line % lineWidth];
+		}
+		double mergeTargetsTime = nanosecondsSince(start, timedLines);
+		start = benchClock::now();
+		for (int line = 0; line < timedLines; line++)
+		{
+			kernels.blend(inputs->targets, inputs->settings, out, lineWidth);
+			checksum += out[line % lineWidth];
+		}
+		double blendTime = nanosecondsSince(start, timedLines);
+		printf("  %-6s  %s, merge %7.1f ns/line, merge with targets %7.1f ns/line, blend %7.1f ns/line (checksum %llx)\n",
+			levelNames[(int)level], differences == 0 ? "matches scalar" : "MISMATCHES", mergeTime, mergeTargetsTime, blendTime,
+			(unsigned long long)checksum);
+		if (differences != 0)
+		{
+			printf("          %d pixels differ from scalar\n", differences);
+		}
+	}
+	printf("\n");
+	delete inputs;
+	delete expectedTargets;
+	delete actualTargets;
+	return totalDifferences;
+}
+
+int main()
+{
+	printf("SSE2: %s, AVX2: %s\n\n", cpuFeatures::hasSSE2() ? "yes" : "no", cpuFeatures::hasAVX2() ? "yes" : "no");
+	benchTileCache();
+	int differences = benchKernels();
+	return differences == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "arena.hpp"
+#include "logging.hpp"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+constexpr size_t hugePageSize = 0x200000;
+static_assert(arenaAllocationSize <= hugePageSize, "The arena should fit in one huge page");
+
+memoryArena::memoryArena(bool useHugePages)
+{
+	base = nullptr;
+	allocatedSize = 0;
+	hugePages = useHugePages && allocateHuge();
+	if (!hugePages && !allocate())
+	{
+		logging::fatal("Couldn't allocate emulated memory", "arena");
+	}
+	logging::info(std::string("Emulated memory uses ") + (hugePages ? "huge pages" : "normal pages"), "arena");
+}
+
+uint8_t* memoryArena::getBIOS()
+{
+	return base + arenaBIOSOffset;
+}
+
+uint8_t* memoryArena::getEWRAM()
+{
+	return base + arenaEWRAMOffset;
+}
+
+uint8_t* memoryArena::getIWRAM()
+{
+	return base + arenaIWRAMOffset;
+}
+
+uint8_t* memoryArena::getIO()
+{
+	return base + arenaIOOffset;
+}
+
+uint8_t* memoryArena::getPalette()
+{
+	return base + arenaPaletteOffset;
+}
+
+uint8_t* memoryArena::getOAM()
+{
+	return base + arenaOAMOffset;
+}
+
+uint8_t* memoryArena::getVRAM()
+{
+	return base + arenaVRAMOffset;
+}
+
+bool memoryArena::usesHugePages()
+{
+	return hugePages;
+}
+
+#ifdef _WIN32
+
+// Large pages need the "Lock pages in memory" privilege, which has to be switched on first.
+static bool enableLockMemoryPrivilege()
+{
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+	{
+		return false;
+	}
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool enabled = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL)
+		&& GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	return enabled;
+}
+
+bool memoryArena::allocateHuge()
+{
+	size_t largePageSize = GetLargePageMinimum();
+	if (largePageSize == 0 || !enableLockMemoryPrivilege())
+	{
+		return false;
+	}
+	size_t size = (arenaAllocationSize + largePageSize - 1) & ~(largePageSize - 1);
+	void* memory = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (memory == NULL)
+	{
+		return false;
+	}
+	base = (uint8_t*)memory;
+	allocatedSize = size;
+	return true;
+}
+
+bool memoryArena::allocate()
+{
+	void* memory = VirtualAlloc(NULL, arenaAllocationSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (memory == NULL)
+	{
+		return false;
+	}
+	base = (uint8_t*)memory;
+	allocatedSize = arenaAllocationSize;
+	return true;
+}
+
+memoryArena::~memoryArena()
+{
+	VirtualFree(base, 0, MEM_RELEASE);
+}
+
+#else
+
+bool memoryArena::allocateHuge()
+{
+#ifdef MAP_HUGETLB
+	void* memory = mmap(nullptr, hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (memory != MAP_FAILED)
+	{
+		base = (uint8_t*)memory;
+		allocatedSize = hugePageSize;
+		return true;
+	}
+#endif
+	return false;
+}
+
+bool memoryArena::allocate()
+{
+	void* memory = mmap(nullptr, arenaAllocationSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+	{
+		return false;
+	}
+	base = (uint8_t*)memory;
+	allocatedSize = arenaAllocationSize;
+	return true;
+}
+
+memoryArena::~memoryArena()
+{
+	munmap(base, allocatedSize);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/* All of the GBA's internal memory lives in one page aligned block, at fixed offsets:
+0x00000 BIOS     16KB
+0x04000 EWRAM   256KB
+0x44000 IWRAM    32KB
+0x4C000 I/O       1KB (the last value written to each register)
+0x4D000 Palette   1KB
+0x4D400 OAM       1KB
+0x4E000 VRAM     96KB
+A few bytes of padding follow VRAM, because the renderer's gathers read 4 bytes at a time
+and can start on VRAM's last byte. */
+
+constexpr size_t arenaBIOSOffset = 0x00000;
+constexpr size_t arenaEWRAMOffset = 0x04000;
+constexpr size_t arenaIWRAMOffset = 0x44000;
+constexpr size_t arenaIOOffset = 0x4C000;
+constexpr size_t arenaPaletteOffset = 0x4D000;
+constexpr size_t arenaOAMOffset = 0x4D400;
+constexpr size_t arenaVRAMOffset = 0x4E000;
+constexpr size_t arenaSize = 0x66000;
+constexpr size_t arenaTailPadding = 16;
+constexpr size_t arenaAllocationSize = arenaSize + arenaTailPadding;
+
+class memoryArena
+{
+	private:
+		uint8_t* base;
+		size_t allocatedSize;
+		bool hugePages;
+
+		bool allocateHuge();
+		bool allocate();
+	public:
+		memoryArena(bool useHugePages);
+		~memoryArena();
+		uint8_t* getBIOS();
+		uint8_t* getEWRAM();
+		uint8_t* getIWRAM();
+		uint8_t* getIO();
+		uint8_t* getPalette();
+		uint8_t* getOAM();
+		uint8_t* getVRAM();
+		bool usesHugePages();
+};
\ No newline at end of file
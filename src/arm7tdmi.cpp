@@ -270,11 +270,12 @@ void arm7tdmi::setSPSR(uint32_t value)
 	}
 }
 
-void arm7tdmi::step()
+// Runs one instruction and returns the number of cycles it took.
+int arm7tdmi::step()
 {
 	if (*halted)
 	{
-		return;
+		return 1;
 	}
 
 	fetch();
@@ -294,6 +295,7 @@ void arm7tdmi::step()
 	}
 
 	//logging::info(helpers::intToHex(getReg(15)) + " " + helpers::intToHex(Pipeline.instrPipeline[Pipeline.pipelinePtr]));
+	return Memory->takeCycles();
 }
 
 void arm7tdmi::fetch()
@@ -301,13 +303,13 @@ void arm7tdmi::fetch()
 	if (state.CPSR & 0x20)
 	{
 		//THUMB
-		Pipeline.instrPipeline[Pipeline.pipelinePtr] = Memory->get16(state.R[15]);
+		Pipeline.instrPipeline[Pipeline.pipelinePtr] = Memory->fetch16(state.R[15]);
 		Pipeline.instrOperation[Pipeline.pipelinePtr] = instruction::UNDEFINED;
 	}
 	else
 	{
 		//ARM
-		Pipeline.instrPipeline[Pipeline.pipelinePtr] = Memory->get32(state.R[15]);
+		Pipeline.instrPipeline[Pipeline.pipelinePtr] = Memory->fetch32(state.R[15]);
 		Pipeline.instrOperation[Pipeline.pipelinePtr] = instruction::UNDEFINED;
 	}
 }
@@ -74,7 +74,7 @@ class arm7tdmi
 {
 	public:
 		arm7tdmi(memory* mem, bool bios, bool* requestIRQ, bool* halted);
-		void step();
+		int step();
 	private:
 		cpuState state;
 		pipeline Pipeline;
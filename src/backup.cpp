@@ -0,0 +1,564 @@
+#include "backup.hpp"
+#include "logging.hpp"
+#include "helpers.hpp"
+#include "simd.hpp"
+#include <cstring>
+#include <cctype>
+
+/* GamePak save memory lives at 0x0E000000 (SRAM and Flash) or in the top of
+the ROM area at 0x0D000000 (EEPROM).
+
+SRAM:   32KB, read and written a byte at a time.
+Flash:  64KB or 128KB. Writes are commands, prefixed with 0xAA to 0x5555 then
+        0x55 to 0x2AAA. 128KB chips are split into two banks selected by command 0xB0.
+EEPROM: 512 bytes (6 bit addresses) or 8KB (14 bit addresses), accessed one bit
+        at a time through bit 0 of 16 bit accesses, almost always by DMA 3.
+        Read request:  "11", address, "0". Then 68 bits are read back: 4 junk bits and 64 data bits.
+        Write request: "10", address, 64 data bits, "0". */
+
+constexpr uint32_t sramSize = 0x8000;
+constexpr uint32_t flashBankSize = 0x10000;
+
+backup* backup::create(backupType type, std::string savePath)
+{
+	switch (type)
+	{
+		case backupType::SRAM: return new sram(savePath);
+		case backupType::Flash64K: return new flash(savePath, false);
+		case backupType::Flash128K: return new flash(savePath, true);
+		case backupType::EEPROM: return new eeprom(savePath, 0);
+		case backupType::EEPROM4K: return new eeprom(savePath, 6);
+		case backupType::EEPROM64K: return new eeprom(savePath, 14);
+		default: return nullptr;
+	}
+}
+
+std::string backup::typeName(backupType type)
+{
+	switch (type)
+	{
+		case backupType::SRAM: return "SRAM";
+		case backupType::Flash64K: return "Flash 64K";
+		case backupType::Flash128K: return "Flash 128K";
+		case backupType::EEPROM: return "EEPROM";
+		case backupType::EEPROM4K: return "EEPROM 4K";
+		case backupType::EEPROM64K: return "EEPROM 64K";
+		default: return "None";
+	}
+}
+
+/* Games link in one of Nintendo's save libraries, which leave an ID string like
+"FLASH1M_V103" in the ROM. Every ID ends in "_V", so the ROM is scanned once for
+that pair and each hit is checked against the library names before it. */
+
+struct saveLibrary
+{
+	const char* name;
+	uint32_t length;
+	backupType type;
+};
+
+static const saveLibrary saveLibraries[] = {
+	{ "EEPROM", 6, backupType::EEPROM },
+	{ "SRAM", 4, backupType::SRAM },
+	{ "FLASH", 5, backupType::Flash64K },
+	{ "FLASH512", 8, backupType::Flash64K },
+	{ "FLASH1M", 7, backupType::Flash128K }
+};
+
+// Games that the ID scan gets wrong, by game code
+struct saveOverride
+{
+	const char* gameCode;
+	backupType type;
+};
+
+static const saveOverride saveOverrides[] = {
+	{ "AI2E", backupType::None }, // Iridion II
+	{ "AI2P", backupType::None },
+	{ "ALUE", backupType::EEPROM4K }, // Super Monkey Ball Jr.
+	{ "ALUP", backupType::EEPROM4K },
+	{ "AWRE", backupType::Flash64K }, // Advance Wars
+	{ "AWRP", backupType::Flash64K }
+};
+
+// rom[pos] is the '_' of a "_V" pair
+static bool matchSaveLibrary(const uint8_t* rom, uint32_t pos, backupType* type)
+{
+	for (const saveLibrary& library : saveLibraries)
+	{
+		if (pos >= library.length && memcmp(rom + pos - library.length, library.name, library.length) == 0)
+		{
+			*type = library.type;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool scanScalar(const uint8_t* rom, uint32_t start, uint32_t romSize, backupType* type)
+{
+	for (uint32_t pos = start; pos + 1 < romSize; pos++)
+	{
+		if (rom[pos] == '_' && rom[pos + 1] == 'V' && matchSaveLibrary(rom, pos, type))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef QGBA_X86
+static bool scanSSE2(const uint8_t* rom, uint32_t romSize, backupType* type)
+{
+	const __m128i underscore = _mm_set1_epi8('_');
+	const __m128i v = _mm_set1_epi8('V');
+	uint32_t pos = 0;
+	for (; pos + 17 <= romSize; pos += 16)
+	{
+		__m128i first = _mm_loadu_si128((const __m128i*)(rom + pos));
+		__m128i second = _mm_loadu_si128((const __m128i*)(rom + pos + 1));
+		uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, underscore), _mm_cmpeq_epi8(second, v)));
+		while (mask != 0)
+		{
+			if (matchSaveLibrary(rom, pos + cpuFeatures::countTrailingZeros(mask), type))
+			{
+				return true;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return scanScalar(rom, pos, romSize, type);
+}
+
+QGBA_TARGET_AVX2 static bool scanAVX2(const uint8_t* rom, uint32_t romSize, backupType* type)
+{
+	const __m256i underscore = _mm256_set1_epi8('_');
+	const __m256i v = _mm256_set1_epi8('V');
+	uint32_t pos = 0;
+	for (; pos + 33 <= romSize; pos += 32)
+	{
+		__m256i first = _mm256_loadu_si256((const __m256i*)(rom + pos));
+		__m256i second = _mm256_loadu_si256((const __m256i*)(rom + pos + 1));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, underscore), _mm256_cmpeq_epi8(second, v)));
+		while (mask != 0)
+		{
+			if (matchSaveLibrary(rom, pos + cpuFeatures::countTrailingZeros(mask), type))
+			{
+				return true;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return scanScalar(rom, pos, romSize, type);
+}
+#endif
+
+backupType backup::detectType(const uint8_t* rom, uint32_t romSize)
+{
+	backupType type = backupType::None;
+#ifdef QGBA_X86
+	if (cpuFeatures::hasAVX2())
+	{
+		scanAVX2(rom, romSize, &type);
+		return type;
+	}
+	if (cpuFeatures::hasSSE2())
+	{
+		scanSSE2(rom, romSize, &type);
+		return type;
+	}
+#endif
+	scanScalar(rom, 0, romSize, &type);
+	return type;
+}
+
+// Returns true and sets type if the game has a known save type.
+bool backup::overrideType(std::string gameCode, backupType* type)
+{
+	for (const saveOverride& entry : saveOverrides)
+	{
+		if (gameCode == entry.gameCode)
+		{
+			*type = entry.type;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Names for the --save-type option. Case doesn't matter.
+struct saveTypeName
+{
+	const char* name;
+	backupType type;
+};
+
+static const saveTypeName saveTypeNames[] = {
+	{ "none", backupType::None },
+	{ "sram", backupType::SRAM },
+	{ "flash64k", backupType::Flash64K },
+	{ "flash128k", backupType::Flash128K },
+	{ "eeprom", backupType::EEPROM },
+	{ "eeprom4k", backupType::EEPROM4K },
+	{ "eeprom64k", backupType::EEPROM64K }
+};
+
+bool backup::parseType(std::string name, backupType* type)
+{
+	for (char& c : name)
+	{
+		c = (char)tolower((unsigned char)c);
+	}
+	for (const saveTypeName& entry : saveTypeNames)
+	{
+		if (name == entry.name)
+		{
+			*type = entry.type;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* A save type cache file has two lines: the header key it was detected for
+(game code, header checksum and ROM size) and the type's --save-type name.
+It's ignored if the key doesn't match, like after the ROM file was replaced. */
+bool backup::loadCachedType(std::string cachePath, std::string headerKey, backupType* type)
+{
+	FILE* file = fopen(cachePath.c_str(), "r");
+	if (!file)
+	{
+		return false;
+	}
+	char key[64];
+	char name[32];
+	bool complete = fgets(key, sizeof(key), file) != nullptr && fgets(name, sizeof(name), file) != nullptr;
+	fclose(file);
+	if (!complete)
+	{
+		return false;
+	}
+	key[strcspn(key, "\r\n")] = '\0';
+	name[strcspn(name, "\r\n")] = '\0';
+	return headerKey == key && parseType(name, type);
+}
+
+void backup::saveCachedType(std::string cachePath, std::string headerKey, backupType type)
+{
+	for (const saveTypeName& entry : saveTypeNames)
+	{
+		if (entry.type == type)
+		{
+			FILE* file = fopen(cachePath.c_str(), "w");
+			if (!file)
+			{
+				logging::warning("Couldn't write the save type cache " + cachePath, "backup");
+				return;
+			}
+			fprintf(file, "%s\n%s\n", headerKey.c_str(), entry.name);
+			fclose(file);
+			return;
+		}
+	}
+}
+
+sram::sram(std::string savePath) : file(savePath, sramSize, 0xFF)
+{
+}
+
+uint8_t sram::read8(uint32_t addr)
+{
+	return file.getData()[addr & (sramSize - 1)];
+}
+
+void sram::write8(uint32_t addr, uint8_t value)
+{
+	addr &= sramSize - 1;
+	file.getData()[addr] = value;
+	file.markDirty(addr, 1);
+}
+
+flash::flash(std::string savePath, bool largeChip) : file(savePath, largeChip ? flashBankSize * 2 : flashBankSize, 0xFF)
+{
+	this->largeChip = largeChip;
+	if (largeChip)
+	{
+		// Sanyo
+		manufacturerID = 0x62;
+		deviceID = 0x13;
+	}
+	else
+	{
+		// Panasonic
+		manufacturerID = 0x32;
+		deviceID = 0x1B;
+	}
+	unlockStage = 0;
+	idMode = false;
+	erasePrepared = false;
+	writePending = false;
+	bankSwitchPending = false;
+	bankOffset = 0;
+}
+
+uint8_t flash::read8(uint32_t addr)
+{
+	addr &= flashBankSize - 1;
+	if (idMode && addr < 2)
+	{
+		return (addr == 0) ? manufacturerID : deviceID;
+	}
+	return file.getData()[bankOffset + addr];
+}
+
+void flash::write8(uint32_t addr, uint8_t value)
+{
+	addr &= flashBankSize - 1;
+	if (writePending)
+	{
+		writePending = false;
+		file.getData()[bankOffset + addr] = value;
+		file.markDirty(bankOffset + addr, 1);
+		return;
+	}
+	if (bankSwitchPending && addr == 0)
+	{
+		bankSwitchPending = false;
+		bankOffset = (value & 0x1) * flashBankSize;
+		return;
+	}
+	switch (unlockStage)
+	{
+		case 0:
+			if (addr == 0x5555 && value == 0xAA)
+			{
+				unlockStage = 1;
+			}
+			else if (value == 0xF0)
+			{
+				// Some chips use a bare 0xF0 to cancel a command
+				idMode = false;
+				erasePrepared = false;
+			}
+			break;
+		case 1:
+			unlockStage = (addr == 0x2AAA && value == 0x55) ? 2 : 0;
+			break;
+		case 2:
+			unlockStage = 0;
+			command(addr, value);
+			break;
+	}
+}
+
+void flash::command(uint32_t addr, uint8_t value)
+{
+	if (addr != 0x5555)
+	{
+		if (value == 0x30 && erasePrepared)
+		{
+			// Erase one 4KB sector
+			uint32_t sector = bankOffset + (addr & 0xF000);
+			memset(file.getData() + sector, 0xFF, 0x1000);
+			file.markDirty(sector, 0x1000);
+		}
+		else
+		{
+			logging::warning("Unknown flash command " + helpers::intToHex(value) + " at " + helpers::intToHex(addr), "backup");
+		}
+		erasePrepared = false;
+		return;
+	}
+	switch (value)
+	{
+		case 0x90: idMode = true; break;
+		case 0xF0: idMode = false; break;
+		case 0x80: erasePrepared = true; break;
+		case 0x10: // Erase entire chip
+			if (erasePrepared)
+			{
+				memset(file.getData(), 0xFF, file.getSize());
+				file.markDirty(0, file.getSize());
+			}
+			erasePrepared = false;
+			break;
+		case 0xA0: writePending = true; break;
+		case 0xB0:
+			if (largeChip)
+			{
+				bankSwitchPending = true;
+			}
+			break;
+		default:
+			logging::warning("Unknown flash command " + helpers::intToHex(value), "backup");
+			break;
+	}
+}
+
+eeprom::eeprom(std::string savePath, int addressBits)
+{
+	this->savePath = savePath;
+	this->addressBits = 0;
+	file = nullptr;
+	state = eepromState::Idle;
+	readRequest = false;
+	address = 0;
+	buffer = 0;
+	bitCount = 0;
+	if (addressBits == 0)
+	{
+		// An existing save already tells us the size
+		long long existing = saveFile::existingSize(savePath);
+		if (existing == 0x200)
+		{
+			addressBits = 6;
+		}
+		else if (existing == 0x2000)
+		{
+			addressBits = 14;
+		}
+	}
+	if (addressBits != 0)
+	{
+		setAddressBits(addressBits);
+	}
+}
+
+eeprom::~eeprom()
+{
+	delete file;
+}
+
+void eeprom::setAddressBits(int bits)
+{
+	if (addressBits != 0)
+	{
+		return;
+	}
+	addressBits = bits;
+	file = new saveFile(savePath, (bits == 6) ? 0x200 : 0x2000, 0xFF);
+	logging::info(std::string("EEPROM size: ") + ((bits == 6) ? "4K" : "64K"), "backup");
+}
+
+// DMA request lengths give away the address size:
+// 9 or 73 units for 6 bit addresses, 17 or 81 units for 14 bit addresses.
+void eeprom::setRequestLength(uint32_t units)
+{
+	if (addressBits != 0 || state != eepromState::Idle)
+	{
+		return;
+	}
+	switch (units)
+	{
+		case 9: case 73: setAddressBits(6); break;
+		case 17: case 81: setAddressBits(14); break;
+	}
+}
+
+uint8_t eeprom::read8(uint32_t addr)
+{
+	if (addr & 0x1)
+	{
+		return 0;
+	}
+	return readBit();
+}
+
+void eeprom::write8(uint32_t addr, uint8_t value)
+{
+	if (addr & 0x1)
+	{
+		return;
+	}
+	writeBit(value & 0x1);
+}
+
+bool eeprom::readBit()
+{
+	if (state != eepromState::Reading)
+	{
+		return true; // Ready
+	}
+	bool bit = false;
+	if (bitCount >= 4)
+	{
+		bit = (buffer >> (63 - (bitCount - 4))) & 0x1;
+	}
+	bitCount++;
+	if (bitCount == 68)
+	{
+		state = eepromState::Idle;
+	}
+	return bit;
+}
+
+void eeprom::writeBit(bool bit)
+{
+	switch (state)
+	{
+		case eepromState::Idle:
+		case eepromState::Reading:
+			// Every request starts with a 1
+			if (bit)
+			{
+				state = eepromState::Command;
+			}
+			break;
+		case eepromState::Command:
+			readRequest = bit;
+			if (addressBits == 0)
+			{
+				logging::warning("EEPROM accessed before its size was known, assuming 4K", "backup");
+				setAddressBits(6);
+			}
+			address = 0;
+			bitCount = 0;
+			state = eepromState::Address;
+			break;
+		case eepromState::Address:
+			address = (address << 1) | bit;
+			bitCount++;
+			if (bitCount == addressBits)
+			{
+				// Each address is one 64 bit block. 64K chips only use the low 10 bits.
+				address &= (file->getSize() / 8) - 1;
+				buffer = 0;
+				bitCount = 0;
+				state = readRequest ? eepromState::ReadEnd : eepromState::WriteData;
+			}
+			break;
+		case eepromState::ReadEnd:
+		{
+			uint8_t* block = file->getData() + (address * 8);
+			buffer = 0;
+			for (int i = 0; i < 8; i++)
+			{
+				buffer = (buffer << 8) | block[i];
+			}
+			bitCount = 0;
+			state = eepromState::Reading;
+			break;
+		}
+		case eepromState::WriteData:
+			buffer = (buffer << 1) | bit;
+			bitCount++;
+			if (bitCount == 64)
+			{
+				state = eepromState::WriteEnd;
+			}
+			break;
+		case eepromState::WriteEnd:
+		{
+			uint8_t* block = file->getData() + (address * 8);
+			for (int i = 7; i >= 0; i--)
+			{
+				block[i] = buffer & 0xFF;
+				buffer >>= 8;
+			}
+			file->markDirty(address * 8, 8);
+			state = eepromState::Idle;
+			break;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "savefile.hpp"
+
+enum class backupType
+{
+	None,
+	SRAM,
+	Flash64K,
+	Flash128K,
+	EEPROM, // Size isn't known yet, it gets worked out from the first DMA request
+	EEPROM4K,
+	EEPROM64K
+};
+
+// Cartridge save memory. Each backend keeps its contents in a mapped .sav file.
+class backup
+{
+	public:
+		virtual ~backup() {}
+		virtual uint8_t read8(uint32_t addr) = 0;
+		virtual void write8(uint32_t addr, uint8_t value) = 0;
+		virtual bool isEEPROM() { return false; }
+		static backup* create(backupType type, std::string savePath);
+		static std::string typeName(backupType type);
+		static backupType detectType(const uint8_t* rom, uint32_t romSize);
+		static bool overrideType(std::string gameCode, backupType* type);
+		static bool parseType(std::string name, backupType* type);
+		static bool loadCachedType(std::string cachePath, std::string headerKey, backupType* type);
+		static void saveCachedType(std::string cachePath, std::string headerKey, backupType type);
+};
+
+class sram : public backup
+{
+	private:
+		saveFile file;
+	public:
+		sram(std::string savePath);
+		uint8_t read8(uint32_t addr) override;
+		void write8(uint32_t addr, uint8_t value) override;
+};
+
+class flash : public backup
+{
+	private:
+		saveFile file;
+		bool largeChip; // 128K chips have two 64K banks
+		uint8_t manufacturerID;
+		uint8_t deviceID;
+		int unlockStage; // How much of the 0xAA, 0x55 command prefix has been written
+		bool idMode;
+		bool erasePrepared;
+		bool writePending;
+		bool bankSwitchPending;
+		uint32_t bankOffset;
+
+		void command(uint32_t addr, uint8_t value);
+	public:
+		flash(std::string savePath, bool largeChip);
+		uint8_t read8(uint32_t addr) override;
+		void write8(uint32_t addr, uint8_t value) override;
+};
+
+enum class eepromState
+{
+	Idle,
+	Command,
+	Address,
+	ReadEnd,
+	Reading,
+	WriteData,
+	WriteEnd
+};
+
+class eeprom : public backup
+{
+	private:
+		saveFile* file;
+		std::string savePath;
+		int addressBits; // 6 for 4K, 14 for 64K, 0 if not known yet
+		eepromState state;
+		bool readRequest;
+		uint32_t address;
+		uint64_t buffer;
+		int bitCount;
+
+		void setAddressBits(int bits);
+		void writeBit(bool bit);
+		bool readBit();
+	public:
+		eeprom(std::string savePath, int addressBits);
+		~eeprom();
+		uint8_t read8(uint32_t addr) override;
+		void write8(uint32_t addr, uint8_t value) override;
+		bool isEEPROM() override { return true; }
+		void setRequestLength(uint32_t units);
+};
\ No newline at end of file
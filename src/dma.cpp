@@ -2,13 +2,42 @@
 #include "logging.hpp"
 #include "memory.hpp"
 
-dma::dma(interrupt* Interrupt)
+dma::dma(interrupt* Interrupt, scheduler* Scheduler, waitstate* Waitstate)
 {
 	this->Interrupt = Interrupt;
-	channel0.init(0, Interrupt);
-	channel1.init(1, Interrupt);
-	channel2.init(2, Interrupt);
-	channel3.init(3, Interrupt);
+	this->Scheduler = Scheduler;
+	channel0.init(0, Interrupt, Scheduler, Waitstate);
+	channel1.init(1, Interrupt, Scheduler, Waitstate);
+	channel2.init(2, Interrupt, Scheduler, Waitstate);
+	channel3.init(3, Interrupt, Scheduler, Waitstate);
+	Scheduler->setHandler(eventType::DMA0Start, [](void* owner, uint64_t) { static_cast<dma*>(owner)->start(0); }, this);
+	Scheduler->setHandler(eventType::DMA1Start, [](void* owner, uint64_t) { static_cast<dma*>(owner)->start(1); }, this);
+	Scheduler->setHandler(eventType::DMA2Start, [](void* owner, uint64_t) { static_cast<dma*>(owner)->start(2); }, this);
+	Scheduler->setHandler(eventType::DMA3Start, [](void* owner, uint64_t) { static_cast<dma*>(owner)->start(3); }, this);
+}
+
+// Runs a channel whose start event fired, along with any others due at the same time.
+// Those run in priority order, channel 0 first.
+void dma::start(int channelNum)
+{
+	bool due[4] = { false, false, false, false };
+	due[channelNum] = true;
+	for (int i = 0; i < 4; i++)
+	{
+		eventType event = getChannel(i)->startEvent();
+		if (!due[i] && Scheduler->isScheduled(event) && Scheduler->getDueTime(event) <= Scheduler->getNow())
+		{
+			Scheduler->cancel(event);
+			due[i] = true;
+		}
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		if (due[i])
+		{
+			getChannel(i)->doDMA();
+		}
+	}
 }
 
 void dma::setMemory(memory* Memory)
@@ -69,6 +98,17 @@ uint8_t dma::getRegister(uint32_t addr)
 	}
 }
 
+dmaChannel* dma::getChannel(int channelNum)
+{
+	switch (channelNum)
+	{
+		case 0: return &channel0;
+		case 1: return &channel1;
+		case 2: return &channel2;
+		default: return &channel3;
+	}
+}
+
 void dma::videoBlank(bool vblank)
 {
 	channel0.videoBlank(vblank);
@@ -77,18 +117,25 @@ void dma::videoBlank(bool vblank)
 	channel3.videoBlank(vblank);
 }
 
-void dma::step(int cycles)
+// Only channel 3 does video capture
+void dma::videoCapture(int scanline)
 {
-	channel0.step(cycles);
-	channel1.step(cycles);
-	channel2.step(cycles);
-	channel3.step(cycles);
+	channel3.videoCapture(scanline);
 }
 
-void dmaChannel::init(int channelNum, interrupt* Interrupt)
+// Only channels 1 and 2 can refill the sound FIFOs
+void dma::soundFIFORequest(uint32_t fifoAddr)
+{
+	channel1.soundFIFORequest(fifoAddr);
+	channel2.soundFIFORequest(fifoAddr);
+}
+
+void dmaChannel::init(int channelNum, interrupt* Interrupt, scheduler* Scheduler, waitstate* Waitstate)
 {
 	this->channelNum = channelNum;
 	this->Interrupt = Interrupt;
+	this->Scheduler = Scheduler;
+	this->Waitstate = Waitstate;
 	switch (channelNum)
 	{
 		case 0: srcAddrMask = 0x7FFFFFF; dstAddrMask = 0x7FFFFFF; wordCountMask = 0x3FFF; break;
@@ -99,7 +146,11 @@ void dmaChannel::init(int channelNum, interrupt* Interrupt)
 	srcAddr = 0;
 	dstAddr = 0;
 	enabled = false;
-	dmaWaitCounter = 0;
+}
+
+eventType dmaChannel::startEvent()
+{
+	return (eventType)((int)eventType::DMA0Start + channelNum);
 }
 
 void dmaChannel::setRegister(uint8_t addr, uint8_t value)
@@ -165,6 +216,32 @@ void dmaChannel::setAddrByte(uint8_t value, int byteNum, bool isSrcAddr)
 	}
 }
 
+void dmaChannel::setSourceAddress(uint32_t value)
+{
+	srcAddr = value & srcAddrMask;
+}
+
+void dmaChannel::setDestAddress(uint32_t value)
+{
+	dstAddr = value & dstAddrMask;
+}
+
+void dmaChannel::setWordCount(uint16_t value)
+{
+	wordCount = value & wordCountMask;
+}
+
+void dmaChannel::setControl(uint16_t value)
+{
+	setControl(value & 0xFF, true);
+	setControl(value >> 8, false);
+}
+
+uint16_t dmaChannel::getControl()
+{
+	return getControl(true) | ((uint16_t)getControl(false) << 8);
+}
+
 void dmaChannel::setWordCount(uint8_t value, bool low)
 {
 	if (low) // Low Byte
@@ -199,42 +276,32 @@ void dmaChannel::setControl(uint8_t value, bool low)
 		{
 			srcAddrCounter = srcAddr;
 			dstAddrCounter = dstAddr;
-			wordCounter = wordCount;
-			if (wordCount == 0)
-			{
-				wordCounter = wordCountMask + 1;
-			}
+			reloadWordCount();
 		}
 		if (srcAddrCtrl == 3)
 		{
 			logging::error("Invalid source address control", "dma");
 		}
-		if (startTiming == 1)
-		{
-			logging::important("Attempt to do VBlank DMA: not implemented", "dma");
-		}
-		if (startTiming == 2)
-		{
-			logging::important("Attempt to do HBlank DMA: not implemented", "dma");
-		}
-		if (startTiming == 3)
+		if (enabled && (startTiming == 0))
 		{
-			if (channelNum == 1 || channelNum == 2)
-			{
-				logging::important("Attempt to do sound FIFO DMA: not implemented", "dma");
-			}
-			else if (channelNum == 3)
-			{
-				logging::important("Attempt to do video capture DMA: not implemented", "dma");
-			}
+			Scheduler->schedule(startEvent(), 2); // Wait 2 cycles before doing DMA
 		}
-		if (enabled && (startTiming == 0))
+		else if (!enabled)
 		{
-			dmaWaitCounter = 2; // Wait 2 cycles before doing DMA
+			Scheduler->cancel(startEvent());
 		}
 	}
 }
 
+void dmaChannel::reloadWordCount()
+{
+	wordCounter = wordCount;
+	if (wordCount == 0)
+	{
+		wordCounter = wordCountMask + 1;
+	}
+}
+
 uint8_t dmaChannel::getControl(bool low)
 {
 	if (low) // Low Byte
@@ -255,13 +322,49 @@ uint8_t dmaChannel::getControl(bool low)
 	}
 }
 
+/* The CPU is stopped while a DMA runs. A transfer of n units takes
+2N + 2(n-1)S + 2I cycles, or 4I if both source and destination are on the GamePak bus. */
+int dmaChannel::transferCycles(uint32_t src, uint32_t dst, uint32_t units, bool wordTransfer)
+{
+	int width = wordTransfer ? width32 : width16;
+	int cycles = Waitstate->accessCycles(src, width, false) + Waitstate->accessCycles(dst, width, false);
+	cycles += (units - 1) * (Waitstate->accessCycles(src, width, true) + Waitstate->accessCycles(dst, width, true));
+	cycles += (src >= 0x08000000 && dst >= 0x08000000) ? 4 : 2;
+	return cycles;
+}
+
 void dmaChannel::doDMA()
 {
-	logging::important("DMA " + std::to_string(channelNum), "dma");
-	int incrementAmount = transferType ? 4 : 2;
+	// Sound FIFO DMA always sends 4 words to the same address, whatever the registers say
+	bool soundFIFO = startTiming == 3 && (channelNum == 1 || channelNum == 2);
+	if (soundFIFO)
+	{
+		wordCounter = 4;
+	}
+	bool wordTransfer = transferType || soundFIFO;
+	uint8_t dstControl = soundFIFO ? 2 : dstAddrCtrl;
+	int incrementAmount = wordTransfer ? 4 : 2;
+	int cycles = transferCycles(srcAddrCounter, dstAddrCounter, wordCounter, wordTransfer);
+	if ((dstAddrCounter >> 24) == 0x0D)
+	{
+		// The request length tells an EEPROM how big its addresses are
+		Memory->eepromRequest(wordCounter);
+	}
+	bool dstIncrement = dstControl == 0 || dstControl == 3;
+	bool srcFixed = srcAddrCtrl == 2;
+	if (dstIncrement && (srcAddrCtrl == 0 || srcFixed)
+		&& Memory->dmaTransfer(dstAddrCounter, srcAddrCounter, wordCounter, wordTransfer ? width32 : width16, srcFixed))
+	{
+		dstAddrCounter += wordCounter * incrementAmount;
+		if (!srcFixed)
+		{
+			srcAddrCounter += wordCounter * incrementAmount;
+		}
+		wordCounter = 0;
+	}
 	for (; wordCounter > 0; wordCounter--)
 	{
-		if (transferType) // 32 bit
+		if (wordTransfer) // 32 bit
 		{
 			Memory->set32(dstAddrCounter, Memory->get32(srcAddrCounter));
 		}
@@ -269,7 +372,7 @@ void dmaChannel::doDMA()
 		{
 			Memory->set16(dstAddrCounter, Memory->get16(srcAddrCounter));
 		}
-		switch (dstAddrCtrl)
+		switch (dstControl)
 		{
 			case 0: case 3: dstAddrCounter += incrementAmount; break;
 			case 1: dstAddrCounter -= incrementAmount; break;
@@ -280,6 +383,9 @@ void dmaChannel::doDMA()
 			case 1: srcAddrCounter -= incrementAmount; break;
 		}
 	}
+	// The stall goes straight onto the clock. Events due during it still fire, just after the copy.
+	Memory->takeCycles();
+	Scheduler->addCycles(cycles);
 	if (irqOnFinish)
 	{
 		switch (channelNum)
@@ -294,22 +400,48 @@ void dmaChannel::doDMA()
 	{
 		enabled = false;
 	}
+	else
+	{
+		// Repeating DMAs stay enabled and go again from the next trigger
+		reloadWordCount();
+		if (dstAddrCtrl == 3)
+		{
+			dstAddrCounter = dstAddr;
+		}
+	}
 }
 
-void dmaChannel::videoBlank(bool vblank)
+void dmaChannel::soundFIFORequest(uint32_t fifoAddr)
 {
+	if (enabled && startTiming == 3 && dstAddr == fifoAddr)
+	{
+		Scheduler->schedule(startEvent(), 0);
+	}
+}
 
+// Video capture DMA runs once per line from line 2 to 161, then stops at line 162
+void dmaChannel::videoCapture(int scanline)
+{
+	if (!enabled || startTiming != 3)
+	{
+		return;
+	}
+	if (scanline == 162)
+	{
+		enabled = false;
+		Scheduler->cancel(startEvent());
+	}
+	else if (scanline >= 2 && scanline < 162)
+	{
+		Scheduler->schedule(startEvent(), 0);
+	}
 }
 
-void dmaChannel::step(int cycles)
+// Called at the start of HBlank on visible lines, and at the start of VBlank
+void dmaChannel::videoBlank(bool vblank)
 {
-	if (dmaWaitCounter > 0)
+	if (enabled && startTiming == (vblank ? 1 : 2))
 	{
-		dmaWaitCounter -= cycles;
-		if (dmaWaitCounter <= 0)
-		{
-			dmaWaitCounter = 0;
-			doDMA();
-		}
+		Scheduler->schedule(startEvent(), 0);
 	}
 }
\ No newline at end of file
@@ -1,12 +1,16 @@
 #pragma once
 #include <cstdint>
 #include "interrupt.hpp"
+#include "scheduler.hpp"
+#include "waitstate.hpp"
 
 class memory;
 class dmaChannel
 {
 	private:
 		interrupt* Interrupt;
+		scheduler* Scheduler;
+		waitstate* Waitstate;
 
 		int channelNum;
 		uint32_t srcAddrMask;
@@ -28,36 +32,47 @@ class dmaChannel
 		uint32_t dstAddrCounter;
 		uint32_t wordCounter;
 
-		int dmaWaitCounter;
-
 		void setAddrByte(uint8_t value, int byteNum, bool isSrcAddr);
 		void setWordCount(uint8_t value, bool low);
 		void setControl(uint8_t value, bool low);
 		uint8_t getControl(bool low);
-		void doDMA();
+		void reloadWordCount();
+		int transferCycles(uint32_t src, uint32_t dst, uint32_t units, bool wordTransfer);
 	public:
 		memory* Memory;
-		void init(int channelNum, interrupt* Interrupt);
+		void init(int channelNum, interrupt* Interrupt, scheduler* Scheduler, waitstate* Waitstate);
+		eventType startEvent();
 		void setRegister(uint8_t addr, uint8_t value);
 		uint8_t getRegister(uint8_t addr);
+		void setSourceAddress(uint32_t value);
+		void setDestAddress(uint32_t value);
+		void setWordCount(uint16_t value);
+		void setControl(uint16_t value);
+		uint16_t getControl();
 		void videoBlank(bool vblank);
-		void step(int cycles);
+		void soundFIFORequest(uint32_t fifoAddr);
+		void videoCapture(int scanline);
+		void doDMA();
 };
 
 class dma
 {
 	private:
 		interrupt* Interrupt;
+		scheduler* Scheduler;
 		memory* Memory;
 		dmaChannel channel0;
 		dmaChannel channel1;
 		dmaChannel channel2;
 		dmaChannel channel3;
 	public:
-		dma(interrupt* Interrupt);
+		dma(interrupt* Interrupt, scheduler* Scheduler, waitstate* Waitstate);
+		void start(int channelNum);
 		void setMemory(memory* Memory);
 		void setRegister(uint32_t addr, uint8_t value);
 		uint8_t getRegister(uint32_t addr);
+		dmaChannel* getChannel(int channelNum);
 		void videoBlank(bool vblank);
-		void step(int cycles);
+		void soundFIFORequest(uint32_t fifoAddr);
+		void videoCapture(int scanline);
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "gpu.hpp"
 #include "logging.hpp"
 #include "helpers.hpp"
+#include <cstring>
 
 /* The GBA has a TFT color LCD that is 240 x 160 pixels in size
 and has a refresh rate of exactly 280,896 cpu cycles per frame, or
@@ -20,30 +21,55 @@ constexpr int vBlankScanlines = 68;
 constexpr int xResolution = 240;
 constexpr int yResolution = 160;
 
+constexpr int parallelLineCount = 16; // Fewer queued lines than this aren't worth waking the other threads for
+constexpr size_t maxLoggedBytes = 0x20000; // Past this, the lines so far are drawn so the write log can be emptied
+
 constexpr int xWindowSize = xResolution * 2;
 constexpr int yWindowSize = yResolution * 2;
 
-gpu::gpu(interrupt* Interrupt, dma* DMA)
+gpu::gpu(interrupt* Interrupt, dma* DMA, memoryArena* Arena, scheduler* Scheduler, threadPool* Pool)
 {
 	this->Interrupt = Interrupt;
 	this->DMA = DMA;
-	cycleCounter = 0;
+	this->Scheduler = Scheduler;
+	this->Pool = Pool;
+	lineStartTime = Scheduler->getNow();
 	currentScanline = 0;
-	vblank = false;
-	hblank = false;
-	vcountMatch = false;
 	vCountSetting = 0;
 	vblankIRQEnable = false;
 	hblankIRQEnable = false;
 	vcountIRQEnable = false;
-	paletteRAM = new uint8_t[1024];
-	vram = new uint8_t[98304];
-	objectRAM = new uint8_t[1024];
-	memset(paletteRAM, 0, 1024);
-	memset(vram, 0, 98304);
-	memset(objectRAM, 0, 1024);
-
-	screenData = new uint8_t[xResolution * yResolution * 3];
+	memset(&state, 0, sizeof(state)); // Anything not set below starts at 0
+	state.videoMode = 0;
+	state.bitmapFrame = false;
+	state.objMapping1D = false;
+	state.enableOBJ = false;
+	for (int bg = 0; bg < 4; bg++)
+	{
+		state.enableBG[bg] = false;
+		state.BGControl[bg].set(0);
+		state.BGXOffset[bg] = 0;
+		state.BGYOffset[bg] = 0;
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		state.BGAffine[i].pa = 0x100;
+		state.BGAffine[i].pb = 0;
+		state.BGAffine[i].pc = 0;
+		state.BGAffine[i].pd = 0x100;
+		state.BGAffine[i].x = 0;
+		state.BGAffine[i].y = 0;
+		BGXReference[i] = 0;
+		BGYReference[i] = 0;
+	}
+	state.bgMosaicWidth = 1;
+	state.bgMosaicHeight = 1;
+	state.objMosaicWidth = 1;
+	state.objMosaicHeight = 1;
+	affineLine = 0;
+	paletteRAM = Arena->getPalette();
+	vram = Arena->getVRAM();
+	objectRAM = Arena->getOAM();
 
 	gpu::window = SDL_CreateWindow("qGBA", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, xWindowSize, yWindowSize, SDL_WINDOW_SHOWN);
 	if (gpu::window == NULL)
@@ -55,287 +81,434 @@ gpu::gpu(interrupt* Interrupt, dma* DMA)
 	{
 		logging::fatal("Renderer could not be created! SDL_Error: " + std::string(SDL_GetError()));
 	}
-	gpu::screenTexture = SDL_CreateTexture(gpu::screenRenderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING, xResolution, yResolution);
+	uint32_t pixelFormat = choosePixelFormat();
+	gpu::screenTexture = SDL_CreateTexture(gpu::screenRenderer, pixelFormat, SDL_TEXTUREACCESS_STREAMING, xResolution, yResolution);
+	if (gpu::screenTexture == NULL)
+	{
+		logging::fatal("Texture could not be created! SDL_Error: " + std::string(SDL_GetError()));
+	}
+	frameBuffer = new uint32_t[xResolution * yResolution]();
+	memset(rowChanged, 0, sizeof(rowChanged));
+	linePixels = (uint8_t*)frameBuffer;
+	linePitch = xResolution * 4;
+	renderedLines = 0;
+	queuedCount = 0;
+	sliceCount = 1;
+	videoMemoryVersion = 0;
+	for (int line = 0; line < yResolution; line++)
+	{
+		lineHashes[line] = 0; // Nothing matches this, so the first frame gets drawn
+	}
+
+	for (int thread = 0; thread < Pool->getThreadCount(); thread++)
+	{
+		videoMemoryCopy Copy;
+		Copy.memory = new uint8_t[arenaAllocationSize - arenaPaletteOffset](); // Includes the padding after VRAM
+		memcpy(Copy.memory, paletteRAM, arenaSize - arenaPaletteOffset);
+		uint8_t* copyVRAM = Copy.memory + (arenaVRAMOffset - arenaPaletteOffset);
+		Copy.Tiles = new tileCache(copyVRAM);
+		Copy.Palette = new paletteCache(Copy.memory, pixelFormat == SDL_PIXELFORMAT_ABGR8888);
+		Copy.Objects = new objectList(Copy.memory + (arenaOAMOffset - arenaPaletteOffset));
+		Copy.Renderer = new renderer(Copy.Palette, copyVRAM, Copy.Tiles, Copy.Objects);
+		Copy.appliedWrites = 0;
+		Copies.push_back(Copy);
+	}
+	writeData.reserve(maxLoggedBytes);
+
+	Scheduler->setHandler(eventType::HBlankStart, [](void* owner, uint64_t) { static_cast<gpu*>(owner)->hblankStart(); }, this);
+	Scheduler->setHandler(eventType::ScanlineEnd, [](void* owner, uint64_t time) { static_cast<gpu*>(owner)->scanlineEnd(time); }, this);
+	Scheduler->scheduleAt(eventType::HBlankStart, lineStartTime + hDrawCycles);
+	Scheduler->scheduleAt(eventType::ScanlineEnd, lineStartTime + cyclesPerScanline);
 }
 
 gpu::~gpu()
 {
+	delete[] frameBuffer;
 	SDL_DestroyTexture(gpu::screenTexture);
 	SDL_DestroyRenderer(gpu::screenRenderer);
 	SDL_DestroyWindow(gpu::window);
-	delete[] screenData;
-	delete[] paletteRAM;
-	delete[] vram;
-	delete[] objectRAM;
+	uint64_t tileHits = 0;
+	uint64_t tileMisses = 0;
+	uint64_t tileDecodes = 0;
+	for (videoMemoryCopy& Copy : Copies)
+	{
+		tileHits += Copy.Renderer->getTileStats().hits;
+		tileMisses += Copy.Renderer->getTileStats().misses;
+		tileDecodes += Copy.Tiles->getDecodes();
+		delete Copy.Renderer;
+		delete Copy.Tiles;
+		delete Copy.Palette;
+		delete Copy.Objects;
+		delete[] Copy.memory;
+	}
+	if (tileHits + tileMisses > 0)
+	{
+		logging::info("Tile cache: " + std::to_string(tileHits) + " hits, " + std::to_string(tileMisses) + " misses, "
+			+ std::to_string(tileDecodes) + " tile decodes", "gpu");
+	}
 }
 
-void gpu::step(int cycles)
+// The PPU only does anything at two points in each scanline, so those are scheduled events
+// and the rest of its state (VCOUNT, DISPSTAT flags) comes from the cycle clock.
+void gpu::hblankStart()
 {
-	cycleCounter += cycles;
-	bool oldhblank = hblank;
-	hblank = cycleCounter >= hDrawCycles;
-	if (!oldhblank && hblank)
+	if (!inVBlank())
 	{
 		DMA->videoBlank(false);
-		if (hblankIRQEnable)
+	}
+	if (hblankIRQEnable)
+	{
+		Interrupt->requestInterrupt(interruptType::HBlank);
+	}
+}
+
+void gpu::scanlineEnd(uint64_t time)
+{
+	currentScanline++;
+	if (currentScanline == vDrawScanlines)
+	{
+		catchUp();
+		DMA->videoBlank(true);
+		if (vblankIRQEnable)
 		{
-			Interrupt->requestInterrupt(interruptType::HBlank);
+			Interrupt->requestInterrupt(interruptType::VBlank);
 		}
+		displayScreen();
 	}
-	if (cycleCounter >= cyclesPerScanline)
+	if (currentScanline == vDrawScanlines + vBlankScanlines)
 	{
-		cycleCounter %= cyclesPerScanline;
-		if (vblank == false)
+		currentScanline = 0;
+		renderedLines = 0;
+		// The affine reference points are reloaded for each frame
+		for (int i = 0; i < 2; i++)
 		{
-			drawScanline();
+			state.BGAffine[i].x = BGXReference[i];
+			state.BGAffine[i].y = BGYReference[i];
 		}
-		currentScanline++;
-		if (currentScanline == vDrawScanlines)
+		affineLine = 0;
+	}
+	DMA->videoCapture(currentScanline);
+	if (vcountIRQEnable && vcountMatches())
+	{
+		Interrupt->requestInterrupt(interruptType::VCounter);
+	}
+	lineStartTime = time;
+	Scheduler->scheduleAt(eventType::HBlankStart, lineStartTime + hDrawCycles);
+	Scheduler->scheduleAt(eventType::ScanlineEnd, lineStartTime + cyclesPerScanline);
+}
+
+bool gpu::inVBlank()
+{
+	return currentScanline >= vDrawScanlines;
+}
+
+bool gpu::inHBlank()
+{
+	return Scheduler->getNow() - lineStartTime >= hDrawCycles;
+}
+
+bool gpu::vcountMatches()
+{
+	return currentScanline == vCountSetting;
+}
+
+/* Lines aren't drawn as the beam passes them. Once a line's HDraw has finished,
+it gets queued with a copy of the display registers the next time a register
+or video memory is written. Queued lines are drawn together at VBlank, spread over
+the thread pool. Video memory writes go into a log instead of waiting for the lines
+before them to be drawn, and each renderer's copy of video memory replays the log
+up to the line it's drawing, so a frame with mid-frame writes is drawn in parallel too.
+
+Each queued line remembers a hash of its state and the video memory version.
+A line whose hash hasn't changed since it was last drawn is still correct in
+the texture, so it's skipped, which makes a static screen cost nothing. */
+void gpu::queueDueLines()
+{
+	int dueLines = inVBlank() ? vDrawScanlines : currentScanline + (inHBlank() ? 1 : 0);
+	if (renderedLines >= dueLines)
+	{
+		return;
+	}
+	for (int line = renderedLines; line < dueLines; line++)
+	{
+		renderState& lineState = lineStates[line];
+		lineState = state;
+		for (int i = 0; i < 2; i++)
 		{
-			vblank = true;
-			DMA->videoBlank(true);
-			if (vblankIRQEnable)
-			{
-				Interrupt->requestInterrupt(interruptType::VBlank);
-			}
-			displayScreen();
+			// The affine reference point moves on by (pb, pd) every line
+			lineState.BGAffine[i].x += (line - affineLine) * state.BGAffine[i].pb;
+			lineState.BGAffine[i].y += (line - affineLine) * state.BGAffine[i].pd;
 		}
-		if (currentScanline == vDrawScanlines + vBlankScanlines)
+		uint64_t stateHash = hashState(lineState);
+		int mosaicLine = mosaicSourceLine(lineState, line);
+		if (mosaicLine != line)
 		{
-			vblank = false;
-			currentScanline = 0;
+			// Mosaic BGs are drawn from the source line's registers, so it's part of this line's hash
+			stateHash = (stateHash ^ lineHashes[mosaicLine]) * 0x100000001B3;
 		}
-		vcountMatch = (currentScanline == vCountSetting);
-		if (vcountIRQEnable && vcountMatch)
+		if (lineHashes[line] == stateHash)
 		{
-			Interrupt->requestInterrupt(interruptType::VCounter);
+			continue;
 		}
+		queuedLines[queuedCount++] = line;
+		lineHashes[line] = stateHash;
 	}
-	
+	renderedLines = dueLines;
 }
 
-void gpu::drawScanline()
+/* Draws every line that's due, then brings every copy of video memory up to date and empties the write log.
+The queued lines are split into one slice per copy, in order, and the slices are drawn at the same time.
+Each slice's copy only has to replay the log, so the slices don't depend on each other. */
+void gpu::catchUp()
 {
-	/*
-	0 - 4   Red Intensity(0 - 31)
-	5 - 9   Green Intensity(0 - 31)
-	10 - 14 Blue Intensity(0 - 31)
-	15    Not used
-	*/
-	switch (videoMode)
-	{
-		case 0:
+	queueDueLines();
+	if (queuedCount == 0 && writeLog.empty())
+	{
+		return;
+	}
+	/* When every line has changed, they're drawn straight into the locked texture, so there's no copy.
+	Locking doesn't keep the old pixels, so a partial update is drawn into frameBuffer instead,
+	and each run of changed rows is uploaded at VBlank. */
+	bool wholeFrame = queuedCount == yResolution;
+	if (wholeFrame)
+	{
+		void* pixels;
+		if (SDL_LockTexture(gpu::screenTexture, NULL, &pixels, &linePitch) == 0)
 		{
-			for (int x = 0; x < xResolution; x++)
-			{
-				uint16_t bgPaletteEntries[4] = { 0, 0, 0, 0 };
-				for (int bg = 0; bg < 4; bg++)
-				{
-					bool bgEnable;
-					bgControl BGControl;
-					uint16_t BGXOffset;
-					uint16_t BGYOffset;
-					switch (bg)
-					{
-						case 0: bgEnable = enableBG0; BGControl = BG0Control; BGXOffset = BG0XOffset; BGYOffset = BG0YOffset; break;
-						case 1: bgEnable = enableBG1; BGControl = BG1Control; BGXOffset = BG1XOffset; BGYOffset = BG1YOffset; break;
-						case 2: bgEnable = enableBG2; BGControl = BG2Control; BGXOffset = BG2XOffset; BGYOffset = BG2YOffset; break;
-						case 3: bgEnable = enableBG3; BGControl = BG3Control; BGXOffset = BG3XOffset; BGYOffset = BG3YOffset; break;
-					}
-
-					if (bgEnable)
-					{
-						int mapXSize = (BGControl.screenSize & 0x01) ? 512 : 256;
-						int mapYSize = (BGControl.screenSize & 0x10) ? 512 : 256;
-
-						int adjustedX = (x + BGXOffset) & 0x1FF;
-						int adjustedY = (currentScanline + BGYOffset) & 0x1FF;
-						uint32_t mapBaseAddr = (uint32_t)BGControl.screenBaseBlock << 11;
-
-						bool xOverflow = adjustedX >= 256;
-						bool yOverflow = adjustedY >= 256;
-						switch (BGControl.screenSize)
-						{
-							case 0x1:
-								if (xOverflow)
-								{
-									// we're in screenblock 1
-									mapBaseAddr += 2048;
-								}
-								break;
-							case 0x2:
-								if (yOverflow)
-								{
-									// we're in screenblock 1
-									mapBaseAddr += 2048;
-								}
-								break;
-							case 0x3:
-								if (xOverflow && yOverflow)
-								{
-									// we're in screenblock 3
-									mapBaseAddr += 2048 * 3;
-								}
-								else if (xOverflow)
-								{
-									// we're in screenblock 1
-									mapBaseAddr += 2048;
-								}
-								else if (yOverflow)
-								{
-									// we're in screenblock 2
-									mapBaseAddr += 2048 * 2;
-								}
-								break;
-						}
-						adjustedX %= 256;
-						adjustedY %= 256;
-
-						uint32_t mapEntryAddr = mapBaseAddr + ((adjustedX / 8) * 2) + ((adjustedY / 8) * 32 * 2);
-						uint16_t mapEntry = vram[mapEntryAddr] | (((uint16_t)vram[mapEntryAddr + 1]) << 8);
-
-						uint32_t tileBaseAddr = (uint32_t)BGControl.charBaseBlock << 14;
-						uint32_t tileAddr = tileBaseAddr + ((mapEntry & 0x3FF) * (BGControl.colourDepth ? 64 : 32));
-						uint8_t tileRow = adjustedY % 8;
-						uint8_t tileColumn = adjustedX % 8;
-						if (mapEntry & 0x400) // Horizontal Flip
-						{
-							tileColumn = 7 - tileColumn;
-						}
-						if (mapEntry & 0x800) // Vertical flip
-						{
-							tileRow = 7 - tileRow;
-						}
-						if (BGControl.colourDepth) // 256 colours, 1 palette.
-						{
-							uint8_t pixelEntryAddr = (tileRow * 8) + tileColumn;
-							uint16_t pixelEntry = vram[tileAddr + pixelEntryAddr];
-							bgPaletteEntries[bg] = pixelEntry;
-							//uint16_t paletteColour = paletteRAM[pixelEntry * 2] | ((uint16_t)paletteRAM[(pixelEntry * 2) + 1] << 8);
-							//plotPixel(x, currentScanline, paletteColour);
-						}
-						else // 16 colours, 16 palettes.
-						{
-							uint8_t paletteNum = mapEntry >> 12;
-							uint16_t paletteBaseAddr = paletteNum * 16;
-							uint16_t paletteEntryAddr = paletteBaseAddr;
-							uint8_t pixelEntryAddr = (tileRow * 4) + tileColumn / 2;
-							uint8_t pixelEntry = vram[tileAddr + pixelEntryAddr];
-							if (tileColumn & 1)
-							{
-								paletteEntryAddr += pixelEntry >> 4;
-							}
-							else
-							{
-								paletteEntryAddr += pixelEntry & 0xF;
-							}
-							bgPaletteEntries[bg] = paletteEntryAddr;
-							//uint16_t paletteColour = paletteRAM[paletteEntryAddr * 2] | ((uint16_t)paletteRAM[(paletteEntryAddr * 2) + 1] << 8);
-							//plotPixel(x, currentScanline, paletteColour);
-						}
-					}
-				}
-				uint16_t baseColour = paletteLookup(0);
-				plotPixel(x, currentScanline, baseColour);
-				int prioritySortedList[4];
-				for (int i = 0, listIndex = 0; i < 4; i++)
-				{
-					if (BG0Control.priority == i) { prioritySortedList[listIndex++] = 0; }
-					if (BG1Control.priority == i) { prioritySortedList[listIndex++] = 1; }
-					if (BG2Control.priority == i) { prioritySortedList[listIndex++] = 2; }
-					if (BG3Control.priority == i) { prioritySortedList[listIndex++] = 3; }
-				}
-				//for (int i = 3; i >= 0; i--)
-				for (int i = 0; i < 4; i++)
-				{
-					uint16_t bgPixPaletteEntry = bgPaletteEntries[prioritySortedList[i]];
-					if (bgPixPaletteEntry != 0)
-					{
-						plotPixel(x, currentScanline, paletteLookup(bgPixPaletteEntry));
-						break;
-					}
-				}
-			}
-			break;
+			linePixels = (uint8_t*)pixels;
 		}
-		case 3:
+		else
 		{
-			if (enableBG2)
-			{
-				for (int x = 0; x < xResolution; x++)
-				{
-					int addr = (currentScanline * xResolution * 2) + (x * 2);
-					uint16_t colour = vram[addr] | ((uint16_t)vram[addr + 1] << 8);
-					plotPixel(x, currentScanline, colour);
-				}
-			}
-			break;
+			logging::error("Texture could not be locked! SDL_Error: " + std::string(SDL_GetError()), "gpu");
+			wholeFrame = false;
 		}
-		case 4:
+	}
+	if (!wholeFrame && queuedCount > 0)
+	{
+		linePixels = (uint8_t*)frameBuffer;
+		linePitch = xResolution * 4;
+		for (int i = 0; i < queuedCount; i++)
 		{
-			if (enableBG2)
-			{
-				for (int x = 0; x < xResolution; x++)
-				{
-					int addr = (currentScanline * xResolution) + x + (bitmapFrame ? 0xA000 : 0);
-					uint8_t paletteIndex = vram[addr];
-					plotPixel(x, currentScanline, paletteLookup(paletteIndex));
-				}
-			}
-			break;
+			rowChanged[queuedLines[i]] = true;
 		}
-		case 5:
+	}
+	if (queuedCount >= parallelLineCount)
+	{
+		sliceCount = (int)Copies.size();
+		Pool->run(sliceCount, [](void* owner, int task, int) { static_cast<gpu*>(owner)->drawSlice(task); }, this);
+	}
+	else
+	{
+		sliceCount = 1;
+		drawSlice(0);
+		for (size_t i = 1; i < Copies.size(); i++)
 		{
-			if (currentScanline >= 128)
-			{
+			applyWrites(Copies[i], vDrawScanlines);
+		}
+	}
+	if (wholeFrame)
+	{
+		SDL_UnlockTexture(gpu::screenTexture);
+	}
+	for (videoMemoryCopy& Copy : Copies)
+	{
+		Copy.appliedWrites = 0;
+	}
+	writeLog.clear();
+	writeData.clear();
+	queuedCount = 0;
+}
+
+// Draws one slice of the queued lines from its own copy, then applies the rest of the log to the copy
+void gpu::drawSlice(int slice)
+{
+	videoMemoryCopy& Copy = Copies[slice];
+	int end = (queuedCount * (slice + 1)) / sliceCount;
+	for (int i = (queuedCount * slice) / sliceCount; i < end; i++)
+	{
+		int line = queuedLines[i];
+		applyWrites(Copy, line);
+		Copy.Objects->update();
+		int mosaicLine = mosaicSourceLine(lineStates[line], line);
+		Copy.Renderer->drawLine(lineStates[line], line, lineStates[mosaicLine], mosaicLine, (uint32_t*)(linePixels + (line * linePitch)));
+	}
+	applyWrites(Copy, vDrawScanlines);
+}
+
+// Copies the logged writes that come before line into Copy, and updates its caches
+void gpu::applyWrites(videoMemoryCopy& Copy, int line)
+{
+	while (Copy.appliedWrites < writeLog.size() && writeLog[Copy.appliedWrites].line <= line)
+	{
+		const videoMemoryWrite& write = writeLog[Copy.appliedWrites++];
+		const uint8_t* data = &writeData[write.dataOffset];
+		uint32_t offset = write.addr & 0xFFFFFF;
+		switch (write.addr >> 24)
+		{
+			case 0x5:
+				memcpy(Copy.memory + offset, data, write.length);
+				Copy.Palette->update(offset, write.length);
+				break;
+			case 0x6:
+				memcpy(Copy.memory + (arenaVRAMOffset - arenaPaletteOffset) + offset, data, write.length);
+				Copy.Tiles->invalidate(offset, write.length);
+				break;
+			case 0x7:
+				memcpy(Copy.memory + (arenaOAMOffset - arenaPaletteOffset) + offset, data, write.length);
+				Copy.Objects->invalidate();
 				break;
-			}
-			if (enableBG2)
-			{
-				for (int x = 0; x < 160; x++)
-				{
-					int frame = bitmapFrame ? 0xA000 : 0;
-					int addr = (currentScanline * 160 * 2) + (x * 2) + frame;
-					uint16_t colour = vram[addr] | ((uint16_t)vram[addr + 1] << 8);
-					plotPixel(x, currentScanline, colour);
-				}
-			}
-			break;
 		}
 	}
 }
 
-uint16_t gpu::paletteLookup(uint16_t paletteIndex)
+/* Adds the bytes that were just written to the log. A write before the same line as the last one,
+that carries straight on from it, joins its entry, so CPU stores filling memory make one entry.
+Writes during VBlank come before the next frame's first line. */
+void gpu::logWrite(uint32_t addr, uint32_t length)
+{
+	const uint8_t* source;
+	switch (addr >> 24)
+	{
+		case 0x5: source = &paletteRAM[addr - 0x05000000]; break;
+		case 0x6: source = &vram[addr - 0x06000000]; break;
+		default: source = &objectRAM[addr - 0x07000000]; break;
+	}
+	int line = inVBlank() ? 0 : renderedLines;
+	if (!writeLog.empty() && writeLog.back().line == line && writeLog.back().addr + writeLog.back().length == addr)
+	{
+		writeLog.back().length += length;
+	}
+	else
+	{
+		writeLog.push_back({ line, addr, length, writeData.size() });
+	}
+	writeData.insert(writeData.end(), source, source + length);
+	if (writeData.size() >= maxLoggedBytes)
+	{
+		catchUp();
+	}
+}
+
+// The first line of a BG mosaic block, or line itself if no enabled BG uses mosaic.
+// Every line is snapshotted in order each frame, so the source line's state is always this frame's.
+int gpu::mosaicSourceLine(const renderState& lineState, int line)
 {
-	return paletteRAM[paletteIndex * 2] | ((uint16_t)paletteRAM[(paletteIndex * 2) + 1] << 8);
+	if (lineState.bgMosaicHeight == 1)
+	{
+		return line;
+	}
+	for (int bg = 0; bg < 4; bg++)
+	{
+		if (lineState.enableBG[bg] && lineState.BGControl[bg].mosaic)
+		{
+			return line - (line % lineState.bgMosaicHeight);
+		}
+	}
+	return line;
 }
 
-void gpu::plotPixel(uint8_t x, uint8_t y, uint16_t colour)
+// One FNV-1a step for each byte of a field. Only used on types without padding.
+template <typename T>
+static uint64_t hashField(uint64_t hash, const T& field)
 {
-	int addr = (y * xResolution) + x;
-	screenData[addr * 3] = (colour & 0x1F) << 3;
-	screenData[(addr * 3) + 1] = ((colour >> 5) & 0x1F) << 3;
-	screenData[(addr * 3) + 2] = ((colour >> 10) & 0x1F) << 3;
+	const uint8_t* bytes = (const uint8_t*)&field;
+	for (size_t i = 0; i < sizeof(field); i++)
+	{
+		hash = (hash ^ bytes[i]) * 0x100000001B3;
+	}
+	return hash;
+}
+
+static_assert(sizeof(bgControl) == 7 && sizeof(affineParams) == 16, "hashState needs these to have no padding");
+
+// FNV-1a over the display registers and the video memory version.
+// The fields are hashed one by one, as renderState's own padding isn't copied reliably.
+uint64_t gpu::hashState(const renderState& lineState)
+{
+	uint64_t hash = 0xCBF29CE484222325;
+	hash = hashField(hash, lineState.videoMode);
+	hash = hashField(hash, lineState.bitmapFrame);
+	hash = hashField(hash, lineState.objMapping1D);
+	hash = hashField(hash, lineState.enableBG);
+	hash = hashField(hash, lineState.enableOBJ);
+	hash = hashField(hash, lineState.BGControl);
+	hash = hashField(hash, lineState.BGXOffset);
+	hash = hashField(hash, lineState.BGYOffset);
+	hash = hashField(hash, lineState.BGAffine);
+	hash = hashField(hash, lineState.enableWindow);
+	hash = hashField(hash, lineState.enableOBJWindow);
+	hash = hashField(hash, lineState.windowLeft);
+	hash = hashField(hash, lineState.windowRight);
+	hash = hashField(hash, lineState.windowTop);
+	hash = hashField(hash, lineState.windowBottom);
+	hash = hashField(hash, lineState.windowInside);
+	hash = hashField(hash, lineState.windowOutside);
+	hash = hashField(hash, lineState.objWindowInside);
+	hash = hashField(hash, lineState.blendFirstTargets);
+	hash = hashField(hash, lineState.blendSecondTargets);
+	hash = hashField(hash, lineState.blendEffect);
+	hash = hashField(hash, lineState.blendFirstWeight);
+	hash = hashField(hash, lineState.blendSecondWeight);
+	hash = hashField(hash, lineState.brightness);
+	hash = hashField(hash, lineState.bgMosaicWidth);
+	hash = hashField(hash, lineState.bgMosaicHeight);
+	hash = hashField(hash, lineState.objMosaicWidth);
+	hash = hashField(hash, lineState.objMosaicHeight);
+	return hashField(hash, videoMemoryVersion);
+}
+
+// The texture uses whichever 32 bit format the renderer lists first, so uploading it doesn't need a conversion
+uint32_t gpu::choosePixelFormat()
+{
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(gpu::screenRenderer, &info) == 0)
+	{
+		for (uint32_t i = 0; i < info.num_texture_formats; i++)
+		{
+			if (info.texture_formats[i] == SDL_PIXELFORMAT_ARGB8888 || info.texture_formats[i] == SDL_PIXELFORMAT_ABGR8888)
+			{
+				return info.texture_formats[i];
+			}
+		}
+	}
+	return SDL_PIXELFORMAT_ARGB8888;
 }
 
 void gpu::setVRAM(uint32_t addr, uint8_t value)
 {
+	uint8_t* target;
 	if (addr >= 0x05000000 && addr < 0x05000400)
 	{
-		paletteRAM[addr - 0x05000000] = value;
+		target = &paletteRAM[addr - 0x05000000];
 	}
 	else if (addr >= 0x06000000 && addr < 0x06018000)
 	{
-		vram[addr - 0x06000000] = value;
+		target = &vram[addr - 0x06000000];
 	}
 	else if (addr >= 0x07000000 && addr < 0x07000400)
 	{
-		objectRAM[addr - 0x07000000] = value;
+		target = &objectRAM[addr - 0x07000000];
 	}
 	else
 	{
 		logging::error("Write to invalid VRAM address: " + helpers::intToHex(addr), "gpu");
+		return;
 	}
+	if (*target == value)
+	{
+		return; // Nothing on screen changes
+	}
+	*target = value;
+	videoMemoryWritten(addr, 1);
+}
+
+// Called after video memory changes, by setVRAM and by writes that go straight into it like DMA copies.
+// Lines that were already due are queued first, so they're drawn without the write.
+void gpu::videoMemoryWritten(uint32_t addr, uint32_t length)
+{
+	queueDueLines();
+	videoMemoryVersion++;
+	logWrite(addr, length);
 }
 
 uint8_t gpu::getVRAM(uint32_t addr)
@@ -361,26 +534,36 @@ uint8_t gpu::getVRAM(uint32_t addr)
 
 void gpu::setRegister(uint32_t addr, uint8_t value)
 {
-	switch (addr - 0x4000000)
+	uint32_t offset = addr - 0x4000000;
+	if (offset < 0x04 || (offset >= 0x08 && offset < 0x56))
+	{
+		queueDueLines(); // This register changes how lines are drawn
+	}
+	if (offset >= 0x20 && offset < 0x40)
+	{
+		setAffineRegister(offset, value);
+		return;
+	}
+	switch (offset)
 	{
 		case 0x00: // DISPCNT byte 1
-			videoMode = value & 0x7;
-			if (videoMode == 1 || videoMode == 2)
-			{
-				logging::error("Switched to unimplemented video mode: " + helpers::intToHex(videoMode), "gpu");
-			}
-			if (videoMode > 5)
+			state.videoMode = value & 0x7;
+			if (state.videoMode > 5)
 			{
-				logging::fatal("Switched to invalid video mode: " + helpers::intToHex(videoMode), "gpu");
+				logging::fatal("Switched to invalid video mode: " + helpers::intToHex(state.videoMode), "gpu");
 			}
-			bitmapFrame = value & 0x10;
+			state.bitmapFrame = value & 0x10;
+			state.objMapping1D = value & 0x40;
 			break;
 		case 0x01: // DISPCNT byte 2
-			enableBG0 = value & 0b00001;
-			enableBG1 = value & 0b00010;
-			enableBG2 = value & 0b00100;
-			enableBG3 = value & 0b01000;
-			enableOBJ = value & 0b10000;
+			state.enableBG[0] = value & 0b00001;
+			state.enableBG[1] = value & 0b00010;
+			state.enableBG[2] = value & 0b00100;
+			state.enableBG[3] = value & 0b01000;
+			state.enableOBJ = value & 0b10000;
+			state.enableWindow[0] = value & 0b00100000;
+			state.enableWindow[1] = value & 0b01000000;
+			state.enableOBJWindow = value & 0b10000000;
 			break;
 		case 0x02: case 0x03: // Green Swap - unimplemented
 			break;
@@ -398,30 +581,62 @@ void gpu::setRegister(uint32_t addr, uint8_t value)
 		case 0x07: // VCOUNT byte 2
 			logging::warning("Write to VCOUNT: 0x4000007", "gpu");
 			break;
-		case 0x08: BG0Control.setLow(value); break;
-		case 0x09: BG0Control.setHigh(value); break;
-		case 0x0A: BG1Control.setLow(value); break;
-		case 0x0B: BG1Control.setHigh(value); break;
-		case 0x0C: BG2Control.setLow(value); break;
-		case 0x0D: BG2Control.setHigh(value); break;
-		case 0x0E: BG3Control.setLow(value); break;
-		case 0x0F: BG3Control.setHigh(value); break;
-		case 0x10: BG0XOffset = (BG0XOffset & ~0xFF) | value; break;
-		case 0x11: BG0XOffset = (BG0XOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x12: BG0YOffset = (BG0YOffset & ~0xFF) | value; break;
-		case 0x13: BG0YOffset = (BG0YOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x14: BG1XOffset = (BG1XOffset & ~0xFF) | value; break;
-		case 0x15: BG1XOffset = (BG1XOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x16: BG1YOffset = (BG1YOffset & ~0xFF) | value; break;
-		case 0x17: BG1YOffset = (BG1YOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x18: BG2XOffset = (BG2XOffset & ~0xFF) | value; break;
-		case 0x19: BG2XOffset = (BG2XOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x1A: BG2YOffset = (BG2YOffset & ~0xFF) | value; break;
-		case 0x1B: BG2YOffset = (BG2YOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x1C: BG3XOffset = (BG3XOffset & ~0xFF) | value; break;
-		case 0x1D: BG3XOffset = (BG3XOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
-		case 0x1E: BG3YOffset = (BG3YOffset & ~0xFF) | value; break;
-		case 0x1F: BG3YOffset = (BG3YOffset & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x08: state.BGControl[0].setLow(value); break;
+		case 0x09: state.BGControl[0].setHigh(value); break;
+		case 0x0A: state.BGControl[1].setLow(value); break;
+		case 0x0B: state.BGControl[1].setHigh(value); break;
+		case 0x0C: state.BGControl[2].setLow(value); break;
+		case 0x0D: state.BGControl[2].setHigh(value); break;
+		case 0x0E: state.BGControl[3].setLow(value); break;
+		case 0x0F: state.BGControl[3].setHigh(value); break;
+		case 0x10: state.BGXOffset[0] = (state.BGXOffset[0] & ~0xFF) | value; break;
+		case 0x11: state.BGXOffset[0] = (state.BGXOffset[0] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x12: state.BGYOffset[0] = (state.BGYOffset[0] & ~0xFF) | value; break;
+		case 0x13: state.BGYOffset[0] = (state.BGYOffset[0] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x14: state.BGXOffset[1] = (state.BGXOffset[1] & ~0xFF) | value; break;
+		case 0x15: state.BGXOffset[1] = (state.BGXOffset[1] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x16: state.BGYOffset[1] = (state.BGYOffset[1] & ~0xFF) | value; break;
+		case 0x17: state.BGYOffset[1] = (state.BGYOffset[1] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x18: state.BGXOffset[2] = (state.BGXOffset[2] & ~0xFF) | value; break;
+		case 0x19: state.BGXOffset[2] = (state.BGXOffset[2] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x1A: state.BGYOffset[2] = (state.BGYOffset[2] & ~0xFF) | value; break;
+		case 0x1B: state.BGYOffset[2] = (state.BGYOffset[2] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x1C: state.BGXOffset[3] = (state.BGXOffset[3] & ~0xFF) | value; break;
+		case 0x1D: state.BGXOffset[3] = (state.BGXOffset[3] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x1E: state.BGYOffset[3] = (state.BGYOffset[3] & ~0xFF) | value; break;
+		case 0x1F: state.BGYOffset[3] = (state.BGYOffset[3] & 0xFF) | (((uint16_t)value & 0x1) << 8); break;
+		case 0x40: state.windowRight[0] = value; break; // WIN0H byte 1
+		case 0x41: state.windowLeft[0] = value; break; // WIN0H byte 2
+		case 0x42: state.windowRight[1] = value; break; // WIN1H byte 1
+		case 0x43: state.windowLeft[1] = value; break; // WIN1H byte 2
+		case 0x44: state.windowBottom[0] = value; break; // WIN0V byte 1
+		case 0x45: state.windowTop[0] = value; break; // WIN0V byte 2
+		case 0x46: state.windowBottom[1] = value; break; // WIN1V byte 1
+		case 0x47: state.windowTop[1] = value; break; // WIN1V byte 2
+		case 0x48: state.windowInside[0] = value & 0x3F; break; // WININ byte 1
+		case 0x49: state.windowInside[1] = value & 0x3F; break; // WININ byte 2
+		case 0x4A: state.windowOutside = value & 0x3F; break; // WINOUT byte 1
+		case 0x4B: state.objWindowInside = value & 0x3F; break; // WINOUT byte 2
+		case 0x4C: // MOSAIC byte 1
+			state.bgMosaicWidth = (value & 0xF) + 1;
+			state.bgMosaicHeight = (value >> 4) + 1;
+			break;
+		case 0x4D: // MOSAIC byte 2
+			state.objMosaicWidth = (value & 0xF) + 1;
+			state.objMosaicHeight = (value >> 4) + 1;
+			break;
+		case 0x4E: case 0x4F: // Unused
+			break;
+		case 0x50: // BLDCNT byte 1
+			state.blendFirstTargets = value & 0x3F;
+			state.blendEffect = value >> 6;
+			break;
+		case 0x51: state.blendSecondTargets = value & 0x3F; break; // BLDCNT byte 2
+		case 0x52: state.blendFirstWeight = value & 0x1F; break; // BLDALPHA byte 1
+		case 0x53: state.blendSecondWeight = value & 0x1F; break; // BLDALPHA byte 2
+		case 0x54: state.brightness = value & 0x1F; break; // BLDY byte 1
+		case 0x55: // BLDY byte 2 (unused)
+			break;
 		default:
 			logging::error("Write to unhandled GPU register: " + helpers::intToHex(addr), "gpu");
 			break;
@@ -434,26 +649,30 @@ uint8_t gpu::getRegister(uint32_t addr)
 	{
 		case 0x00: // DISPCNT byte 1
 		{
-			uint8_t ret = (videoMode & 0x07)
-				| ((uint8_t)bitmapFrame << 4);
+			uint8_t ret = (state.videoMode & 0x07)
+				| ((uint8_t)state.bitmapFrame << 4)
+				| ((uint8_t)state.objMapping1D << 6);
 			return ret;
 		}
 		case 0x01: // DISPCNT byte 2
 		{
-			uint8_t ret = (uint8_t)enableBG0
-				| ((uint8_t)enableBG1 << 1)
-				| ((uint8_t)enableBG2 << 2)
-				| ((uint8_t)enableBG3 << 3)
-				| ((uint8_t)enableOBJ << 4);
+			uint8_t ret = (uint8_t)state.enableBG[0]
+				| ((uint8_t)state.enableBG[1] << 1)
+				| ((uint8_t)state.enableBG[2] << 2)
+				| ((uint8_t)state.enableBG[3] << 3)
+				| ((uint8_t)state.enableOBJ << 4)
+				| ((uint8_t)state.enableWindow[0] << 5)
+				| ((uint8_t)state.enableWindow[1] << 6)
+				| ((uint8_t)state.enableOBJWindow << 7);
 			return ret;
 		}
 		case 0x02: case 0x03: // Green Swap - unimplemented
 			return 0;
 		case 0x04: // DISPSTAT byte 1
 		{
-			uint8_t ret = (uint8_t)vblank
-				| ((uint8_t)hblank << 1)
-				| ((uint8_t)vcountMatch << 2)
+			uint8_t ret = (uint8_t)inVBlank()
+				| ((uint8_t)inHBlank() << 1)
+				| ((uint8_t)vcountMatches() << 2)
 				| ((uint8_t)vblankIRQEnable << 3)
 				| ((uint8_t)hblankIRQEnable << 4)
 				| ((uint8_t)vcountIRQEnable << 5);
@@ -465,58 +684,152 @@ uint8_t gpu::getRegister(uint32_t addr)
 			return currentScanline;
 		case 0x07: // VCOUNT byte 2 (unused)
 			return 0;
-		case 0x08: return BG0Control.getLow();
-		case 0x09: return BG0Control.getHigh();
-		case 0x0A: return BG1Control.getLow();
-		case 0x0B: return BG1Control.getHigh();
-		case 0x0C: return BG2Control.getLow();
-		case 0x0D: return BG2Control.getHigh();
-		case 0x0E: return BG3Control.getLow();
-		case 0x0F: return BG3Control.getHigh();
+		case 0x08: return state.BGControl[0].getLow();
+		case 0x09: return state.BGControl[0].getHigh();
+		case 0x0A: return state.BGControl[1].getLow();
+		case 0x0B: return state.BGControl[1].getHigh();
+		case 0x0C: return state.BGControl[2].getLow();
+		case 0x0D: return state.BGControl[2].getHigh();
+		case 0x0E: return state.BGControl[3].getLow();
+		case 0x0F: return state.BGControl[3].getHigh();
 		case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
 		case 0x18: case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E: case 0x1F:
 			return 0; // BG Scroll Offsets are Write-Only
+		case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
+		case 0x28: case 0x29: case 0x2A: case 0x2B: case 0x2C: case 0x2D: case 0x2E: case 0x2F:
+		case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
+		case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3E: case 0x3F:
+			return 0; // BG Rotation/Scaling Parameters are Write-Only
+		case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
+			return 0; // Window Dimensions are Write-Only
+		case 0x48: return state.windowInside[0];
+		case 0x49: return state.windowInside[1];
+		case 0x4A: return state.windowOutside;
+		case 0x4B: return state.objWindowInside;
+		case 0x4C: case 0x4D: case 0x4E: case 0x4F:
+			return 0; // MOSAIC is Write-Only
+		case 0x50: return state.blendFirstTargets | (state.blendEffect << 6);
+		case 0x51: return state.blendSecondTargets;
+		case 0x52: return state.blendFirstWeight;
+		case 0x53: return state.blendSecondWeight;
+		case 0x54: case 0x55:
+			return 0; // BLDY is Write-Only
 		default:
 			logging::error("Read from unhandled GPU register: " + helpers::intToHex(addr), "gpu");
 			return 0;
 	}
 }
 
-void gpu::displayScreen()
+/* 4000020h - BG2PA - BG2 Rotation/Scaling Parameter A (alias dx) (W)
+4000022h - BG2PB - BG2 Rotation/Scaling Parameter B (alias dmx) (W)
+4000024h - BG2PC - BG2 Rotation/Scaling Parameter C (alias dy) (W)
+4000026h - BG2PD - BG2 Rotation/Scaling Parameter D (alias dmy) (W)
+  Bit   Expl.
+  0-7   Fractional portion (8 bits)
+  8-14  Integer portion    (7 bits)
+  15    Sign               (1 bit)
+
+4000028h - BG2X_L - BG2 Reference Point X-Coordinate, lower 16 bit (W)
+400002Ah - BG2X_H - BG2 Reference Point X-Coordinate, upper 12 bit (W)
+400002Ch - BG2Y_L - BG2 Reference Point Y-Coordinate, lower 16 bit (W)
+400002Eh - BG2Y_H - BG2 Reference Point Y-Coordinate, upper 12 bit (W)
+  Bit   Expl.
+  0-7   Fractional portion (8 bits)
+  8-26  Integer portion    (19 bits)
+  27    Sign               (1 bit)
+  28-31 Not used
+
+BG3 is the same at 4000030h-400003Fh. Writing a reference point also sets the
+internal one that's stepped by PB and PD each line. */
+void gpu::setAffineRegister(uint32_t offset, uint8_t value)
 {
-	SDL_UpdateTexture(gpu::screenTexture, NULL, gpu::screenData, xResolution * 3);
-	SDL_RenderCopy(gpu::screenRenderer, gpu::screenTexture, NULL, NULL);
-	SDL_RenderPresent(gpu::screenRenderer);
+	// Bring the internal reference points up to the next line to be drawn, so the
+	// lines before it keep the old values
+	for (int i = 0; i < 2; i++)
+	{
+		state.BGAffine[i].x += (renderedLines - affineLine) * state.BGAffine[i].pb;
+		state.BGAffine[i].y += (renderedLines - affineLine) * state.BGAffine[i].pd;
+	}
+	affineLine = renderedLines;
+
+	affineParams& params = state.BGAffine[(offset - 0x20) / 0x10];
+	int byteShift = (offset & 0x1) * 8;
+	uint16_t byteMask = 0xFF << byteShift;
+	switch ((offset - 0x20) % 0x10)
+	{
+		case 0x0: case 0x1: params.pa = (params.pa & ~byteMask) | (value << byteShift); break;
+		case 0x2: case 0x3: params.pb = (params.pb & ~byteMask) | (value << byteShift); break;
+		case 0x4: case 0x5: params.pc = (params.pc & ~byteMask) | (value << byteShift); break;
+		case 0x6: case 0x7: params.pd = (params.pd & ~byteMask) | (value << byteShift); break;
+		default:
+		{
+			int i = (offset - 0x20) / 0x10;
+			bool isY = (offset & 0x4);
+			int32_t& reference = isY ? BGYReference[i] : BGXReference[i];
+			int shift = (offset & 0x3) * 8;
+			uint32_t raw = ((uint32_t)reference & ~(0xFFu << shift)) | ((uint32_t)value << shift);
+			reference = helpers::signExtend<int32_t>(raw & 0xFFFFFFF, 28);
+			(isY ? params.y : params.x) = reference;
+			break;
+		}
+	}
+}
+
+void gpu::setBGControl(int bg, uint16_t value)
+{
+	queueDueLines();
+	state.BGControl[bg].set(value);
 }
 
-void bgControl::setLow(uint8_t value)
+uint16_t gpu::getBGControl(int bg)
 {
-	priority = value & 0x3;
-	charBaseBlock = (value >> 2) & 0x3;
-	mosaic = value & 0x40;
-	colourDepth = value & 0x80;
+	return state.BGControl[bg].get();
 }
 
-void bgControl::setHigh(uint8_t value)
+void gpu::setBGXOffset(int bg, uint16_t value)
 {
-	screenBaseBlock = value & 0x1F;
-	displayOverflow = value & 0x20;
-	screenSize = (value >> 6) & 0x3;
+	queueDueLines();
+	state.BGXOffset[bg] = value & 0x1FF;
 }
 
-uint8_t bgControl::getLow()
+void gpu::setBGYOffset(int bg, uint16_t value)
 {
-	uint8_t ret = priority
-		| (charBaseBlock << 2)
-		| ((uint8_t)mosaic << 6)
-		| ((uint8_t)colourDepth << 7);
-	return ret;
+	queueDueLines();
+	state.BGYOffset[bg] = value & 0x1FF;
 }
 
-uint8_t bgControl::getHigh()
+uint16_t gpu::getDispStat()
+{
+	return getRegister(0x4000004) | ((uint16_t)vCountSetting << 8);
+}
+
+uint16_t gpu::getVCount()
+{
+	return currentScanline;
+}
+
+void gpu::displayScreen()
 {
-	uint8_t ret = screenBaseBlock
-		| ((uint8_t)displayOverflow << 5)
-		| (screenSize << 6);
-	return ret;
+	int line = 0;
+	while (line < yResolution)
+	{
+		if (!rowChanged[line])
+		{
+			line++;
+			continue;
+		}
+		int runEnd = line;
+		while (runEnd < yResolution && rowChanged[runEnd])
+		{
+			rowChanged[runEnd++] = false;
+		}
+		SDL_Rect rect = { 0, line, xResolution, runEnd - line };
+		if (SDL_UpdateTexture(gpu::screenTexture, &rect, &frameBuffer[line * xResolution], xResolution * 4) != 0)
+		{
+			logging::error("Texture could not be updated! SDL_Error: " + std::string(SDL_GetError()), "gpu");
+		}
+		line = runEnd;
+	}
+	SDL_RenderCopy(gpu::screenRenderer, gpu::screenTexture, NULL, NULL);
+	SDL_RenderPresent(gpu::screenRenderer);
 }
\ No newline at end of file
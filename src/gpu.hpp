@@ -3,21 +3,32 @@
 #include "SDL.h"
 #include "interrupt.hpp"
 #include "dma.hpp"
+#include "arena.hpp"
+#include "scheduler.hpp"
+#include "renderer.hpp"
+#include "threadpool.hpp"
+#include <vector>
 
-struct bgControl
+// One write to palette RAM, VRAM or OAM that the copies haven't all seen yet
+struct videoMemoryWrite
 {
-	uint8_t priority;
-	uint8_t charBaseBlock;
-	bool mosaic;
-	bool colourDepth; // 0 = 16 colours, 16 palettes. 1 = 256 colours, 1 palette.
-	uint8_t screenBaseBlock;
-	bool displayOverflow;
-	uint8_t screenSize;
-	
-	void setLow(uint8_t value);
-	void setHigh(uint8_t value);
-	uint8_t getLow();
-	uint8_t getHigh();
+	int line; // The first line that's drawn with this write
+	uint32_t addr;
+	uint32_t length;
+	size_t dataOffset; // Where the written bytes start in the log's data
+};
+
+/* A renderer with its own copy of palette RAM, OAM and VRAM, laid out like the arena,
+and the caches built from it. The copy lags behind the real video memory
+and replays the write log up to each line it draws. */
+struct videoMemoryCopy
+{
+	uint8_t* memory;
+	tileCache* Tiles;
+	paletteCache* Palette;
+	objectList* Objects;
+	renderer* Renderer;
+	size_t appliedWrites; // Log entries before this are in memory
 };
 
 class gpu
@@ -25,53 +36,67 @@ class gpu
 	private:
 		interrupt* Interrupt;
 		dma* DMA;
+		scheduler* Scheduler;
+		threadPool* Pool;
 		SDL_Window* window;
 		SDL_Renderer* screenRenderer;
 		SDL_Texture* screenTexture;
-		uint8_t* screenData;
+		uint32_t* frameBuffer; // Lines for a partial update, in the texture's pixel format
+		bool rowChanged[160]; // The rows of frameBuffer that have been redrawn this frame. The rest can be stale.
+		uint8_t* linePixels; // Where lines are being drawn: the locked texture or frameBuffer
+		int linePitch;
+		int renderedLines; // Lines before this have been drawn this frame
+		uint64_t videoMemoryVersion; // Goes up every time video memory changes
+		uint64_t lineHashes[160];
+		renderState lineStates[160]; // The registers each queued line is drawn with
+		int queuedLines[160];
+		int queuedCount;
+		std::vector<videoMemoryWrite> writeLog;
+		std::vector<uint8_t> writeData;
+		std::vector<videoMemoryCopy> Copies; // One for each thread in the pool
+		int sliceCount; // How many pieces the queued lines are split into
 
-		int cycleCounter;
+		uint64_t lineStartTime;
 		uint8_t currentScanline;
 		uint8_t* paletteRAM;
 		uint8_t* vram;
 		uint8_t* objectRAM;
-		uint8_t videoMode;
-		bool bitmapFrame;
-		bool enableBG0;
-		bool enableBG1;
-		bool enableBG2;
-		bool enableBG3;
-		bool enableOBJ;
-		bgControl BG0Control;
-		bgControl BG1Control;
-		bgControl BG2Control;
-		bgControl BG3Control;
-		uint16_t BG0XOffset;
-		uint16_t BG0YOffset;
-		uint16_t BG1XOffset;
-		uint16_t BG1YOffset;
-		uint16_t BG2XOffset;
-		uint16_t BG2YOffset;
-		uint16_t BG3XOffset;
-		uint16_t BG3YOffset;
-		bool vblank;
-		bool hblank;
-		bool vcountMatch;
+		renderState state; // BGAffine holds the internal reference points for affineLine
+		int32_t BGXReference[2]; // The BG2 and BG3 reference point registers
+		int32_t BGYReference[2];
+		int affineLine;
 		uint8_t vCountSetting;
 		bool vblankIRQEnable;
 		bool hblankIRQEnable;
 		bool vcountIRQEnable;
 
-		void drawScanline();
-		uint16_t paletteLookup(uint16_t paletteIndex);
-		void plotPixel(uint8_t x, uint8_t y, uint16_t colour);
+		bool inVBlank();
+		bool inHBlank();
+		bool vcountMatches();
+		uint64_t hashState(const renderState& lineState);
+		int mosaicSourceLine(const renderState& lineState, int line);
+		void setAffineRegister(uint32_t offset, uint8_t value);
+		void queueDueLines();
+		void logWrite(uint32_t addr, uint32_t length);
+		void applyWrites(videoMemoryCopy& Copy, int line);
+		void drawSlice(int slice);
+		uint32_t choosePixelFormat();
 	public:
-		gpu(interrupt* Interrupt, dma* DMA);
+		gpu(interrupt* Interrupt, dma* DMA, memoryArena* Arena, scheduler* Scheduler, threadPool* Pool);
 		~gpu();
-		void step(int cycles);
+		void hblankStart();
+		void scanlineEnd(uint64_t time);
+		void catchUp();
 		void setVRAM(uint32_t addr, uint8_t value);
+		void videoMemoryWritten(uint32_t addr, uint32_t length);
 		uint8_t getVRAM(uint32_t addr);
 		void setRegister(uint32_t addr, uint8_t value);
 		uint8_t getRegister(uint32_t addr);
+		void setBGControl(int bg, uint16_t value);
+		uint16_t getBGControl(int bg);
+		void setBGXOffset(int bg, uint16_t value);
+		void setBGYOffset(int bg, uint16_t value);
+		uint16_t getDispStat();
+		uint16_t getVCount();
 		void displayScreen();
 };
\ No newline at end of file
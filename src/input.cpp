@@ -102,6 +102,11 @@ uint8_t input::getRegister(uint32_t addr)
     }
 }
 
+uint16_t input::getKeyState()
+{
+    return keyState;
+}
+
 void input::setRegister(uint32_t addr, uint8_t value)
 {
     switch (addr)
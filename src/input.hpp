@@ -13,5 +13,6 @@ class input
 		input(interrupt* Interrupt);
 		void keyChanged(SDL_Keycode key, bool value);
 		uint8_t getRegister(uint32_t addr);
+		uint16_t getKeyState();
 		void setRegister(uint32_t addr, uint8_t value);
 };
\ No newline at end of file
@@ -89,4 +89,26 @@ uint8_t interrupt::getRegister(uint32_t addr)
 			logging::error("Read unimplemented control register: " + helpers::intToHex(addr), "interrupt");
 			return 0;
 	}
+}
+
+void interrupt::setInterruptEnable(uint16_t value)
+{
+	interruptEnable = value;
+	updateIRQRequest();
+}
+
+void interrupt::acknowledgeInterrupts(uint16_t value)
+{
+	interruptFlags &= ~value;
+	updateIRQRequest();
+}
+
+uint16_t interrupt::getInterruptEnable()
+{
+	return interruptEnable;
+}
+
+uint16_t interrupt::getInterruptFlags()
+{
+	return interruptFlags;
 }
\ No newline at end of file
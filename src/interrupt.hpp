@@ -26,6 +26,10 @@ class interrupt
 		void requestInterrupt(interruptType type);
 		void setRegister(uint32_t addr, uint8_t value);
 		uint8_t getRegister(uint32_t addr);
+		void setInterruptEnable(uint16_t value);
+		void acknowledgeInterrupts(uint16_t value);
+		uint16_t getInterruptEnable();
+		uint16_t getInterruptFlags();
 	private:
 		bool* requestIRQ;
 		bool* CPUHalt;
@@ -1,27 +1,195 @@
+#include <cstring>
 #include "memory.hpp"
 #include "logging.hpp"
 #include "helpers.hpp"
 
-memory::memory(uint8_t* rom, uint32_t romSize, uint8_t* bios, gpu* GPU, input* Input, interrupt* Interrupt, timers* Timers, dma* DMA)
+memory::memory(uint8_t* rom, uint32_t romSize, memoryArena* Arena, bool biosLoaded, gpu* GPU, input* Input, interrupt* Interrupt, timers* Timers, dma* DMA, sound* Sound, waitstate* Waitstate)
 {
 	cartrom = rom;
 	this->romSize = romSize;
-	this->bios = bios;
+	bios = biosLoaded ? Arena->getBIOS() : nullptr;
+	ewram = Arena->getEWRAM();
+	iwram = Arena->getIWRAM();
+	io = Arena->getIO();
+	paletteRAM = Arena->getPalette();
+	vram = Arena->getVRAM();
+	objectRAM = Arena->getOAM();
 	this->GPU = GPU;
 	this->Input = Input;
 	this->Interrupt = Interrupt;
 	this->Timers = Timers;
 	this->DMA = DMA;
-	iwram = new uint8_t[32768];
-	ewram = new uint8_t[262144];
-	memset(iwram, 0, 32768);
-	memset(ewram, 0, 262144);
+	this->Sound = Sound;
+	this->Waitstate = Waitstate;
+	Backup = nullptr;
+	// EEPROM takes over the whole 0x0D000000 area, unless the ROM is big enough to need it
+	eepromStart = (romSize > 0x1000000) ? 0x0DFFFF00 : 0x0D000000;
+	cycleCount = 0;
+	buildIOTable();
 }
 
 memory::~memory()
 {
-	delete[] iwram;
-	delete[] ewram;
+	for (int i = 0; i < 0x400; i++)
+	{
+		if (ioUnhandledCount[i] > 1)
+		{
+			logging::info("Unhandled I/O register " + helpers::intToHex(0x4000000 + i) + " was accessed " + std::to_string(ioUnhandledCount[i]) + " times", "memory");
+		}
+	}
+}
+
+void memory::buildIOTable()
+{
+	for (int i = 0; i < 0x400; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) -> uint8_t { mem->unhandledIO(addr, false); return 0; };
+		ioTable[i].read16 = nullptr;
+		ioTable[i].read32 = nullptr;
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t) { mem->unhandledIO(addr, true); };
+		ioTable[i].write16 = nullptr;
+		ioTable[i].write32 = nullptr;
+		ioUnhandledCount[i] = 0;
+	}
+
+	// LCD registers
+	for (int i = 0x00; i < 0x56; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->GPU->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->GPU->setRegister(addr, value); };
+	}
+	ioTable[0x04].read16 = [](memory* mem, uint32_t) { return mem->GPU->getDispStat(); };
+	ioTable[0x06].read16 = [](memory* mem, uint32_t) { return mem->GPU->getVCount(); };
+	for (int i = 0x08; i < 0x10; i += 2) // BGxCNT
+	{
+		ioTable[i].read16 = [](memory* mem, uint32_t addr) { return mem->GPU->getBGControl((addr >> 1) & 0x3); };
+		ioTable[i].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->GPU->setBGControl((addr >> 1) & 0x3, value); };
+	}
+	ioTable[0x08].write32 = [](memory* mem, uint32_t, uint32_t value)
+	{
+		mem->GPU->setBGControl(0, value & 0xFFFF);
+		mem->GPU->setBGControl(1, value >> 16);
+	};
+	ioTable[0x0C].write32 = [](memory* mem, uint32_t, uint32_t value)
+	{
+		mem->GPU->setBGControl(2, value & 0xFFFF);
+		mem->GPU->setBGControl(3, value >> 16);
+	};
+	for (int i = 0x10; i < 0x20; i += 4) // BGxHOFS, BGxVOFS
+	{
+		ioTable[i].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->GPU->setBGXOffset((addr >> 2) & 0x3, value); };
+		ioTable[i + 2].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->GPU->setBGYOffset((addr >> 2) & 0x3, value); };
+		ioTable[i].write32 = [](memory* mem, uint32_t addr, uint32_t value)
+		{
+			mem->GPU->setBGXOffset((addr >> 2) & 0x3, value & 0xFFFF);
+			mem->GPU->setBGYOffset((addr >> 2) & 0x3, value >> 16);
+		};
+	}
+
+	// Sound registers. 8 and 16 bit FIFO writes push their bytes in order, low byte first.
+	for (int i = 0x60; i < 0xA8; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->Sound->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->Sound->setRegister(addr, value); };
+	}
+
+	// DMA registers
+	for (int i = 0xB0; i < 0xE0; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->DMA->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->DMA->setRegister(addr, value); };
+	}
+	for (int i = 0xB0; i < 0xE0; i += 12)
+	{
+		ioTable[i].write32 = [](memory* mem, uint32_t addr, uint32_t value) { mem->DMA->getChannel((addr - 0x40000B0) / 12)->setSourceAddress(value); };
+		ioTable[i + 4].write32 = [](memory* mem, uint32_t addr, uint32_t value) { mem->DMA->getChannel((addr - 0x40000B4) / 12)->setDestAddress(value); };
+		ioTable[i + 8].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->DMA->getChannel((addr - 0x40000B8) / 12)->setWordCount(value); };
+		ioTable[i + 8].write32 = [](memory* mem, uint32_t addr, uint32_t value)
+		{
+			dmaChannel* channel = mem->DMA->getChannel((addr - 0x40000B8) / 12);
+			channel->setWordCount((uint16_t)(value & 0xFFFF));
+			channel->setControl((uint16_t)(value >> 16));
+		};
+		ioTable[i + 10].read16 = [](memory* mem, uint32_t addr) { return mem->DMA->getChannel((addr - 0x40000BA) / 12)->getControl(); };
+		ioTable[i + 10].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->DMA->getChannel((addr - 0x40000BA) / 12)->setControl(value); };
+	}
+
+	// Timer registers
+	for (int i = 0x100; i < 0x110; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->Timers->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->Timers->setRegister(addr, value); };
+	}
+	for (int i = 0x100; i < 0x110; i += 4)
+	{
+		ioTable[i].read16 = [](memory* mem, uint32_t addr) { return mem->Timers->getTimer((addr >> 2) & 0x3)->getCounter(); };
+		ioTable[i].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->Timers->getTimer((addr >> 2) & 0x3)->setReload(value); };
+		ioTable[i].write32 = [](memory* mem, uint32_t addr, uint32_t value)
+		{
+			timer* Timer = mem->Timers->getTimer((addr >> 2) & 0x3);
+			Timer->setReload(value & 0xFFFF);
+			Timer->setControl((value >> 16) & 0xFF);
+		};
+		ioTable[i + 2].read16 = [](memory* mem, uint32_t addr) -> uint16_t { return mem->Timers->getTimer((addr >> 2) & 0x3)->getControl(); };
+		ioTable[i + 2].write16 = [](memory* mem, uint32_t addr, uint16_t value) { mem->Timers->getTimer((addr >> 2) & 0x3)->setControl(value & 0xFF); };
+	}
+
+	// Keypad registers
+	for (int i = 0x130; i < 0x134; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->Input->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->Input->setRegister(addr, value); };
+	}
+	ioTable[0x130].read16 = [](memory* mem, uint32_t) { return mem->Input->getKeyState(); };
+
+	// Interrupt and system control registers
+	const int interruptRegs[] = { 0x200, 0x201, 0x202, 0x203, 0x208, 0x209, 0x20A, 0x20B, 0x301 };
+	for (int i : interruptRegs)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->Interrupt->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->Interrupt->setRegister(addr, value); };
+	}
+	ioTable[0x200].read16 = [](memory* mem, uint32_t) { return mem->Interrupt->getInterruptEnable(); };
+	ioTable[0x200].write16 = [](memory* mem, uint32_t, uint16_t value) { mem->Interrupt->setInterruptEnable(value); };
+	ioTable[0x200].read32 = [](memory* mem, uint32_t) { return mem->Interrupt->getInterruptEnable() | ((uint32_t)mem->Interrupt->getInterruptFlags() << 16); };
+	ioTable[0x200].write32 = [](memory* mem, uint32_t, uint32_t value)
+	{
+		mem->Interrupt->setInterruptEnable(value & 0xFFFF);
+		mem->Interrupt->acknowledgeInterrupts(value >> 16);
+	};
+	ioTable[0x202].read16 = [](memory* mem, uint32_t) { return mem->Interrupt->getInterruptFlags(); };
+	ioTable[0x202].write16 = [](memory* mem, uint32_t, uint16_t value) { mem->Interrupt->acknowledgeInterrupts(value); };
+
+	// Waitstate control
+	for (int i = 0x204; i < 0x208; i++)
+	{
+		ioTable[i].read8 = [](memory* mem, uint32_t addr) { return mem->Waitstate->getRegister(addr); };
+		ioTable[i].write8 = [](memory* mem, uint32_t addr, uint8_t value) { mem->Waitstate->setRegister(addr, value); };
+	}
+	ioTable[0x204].read16 = [](memory* mem, uint32_t) { return mem->Waitstate->getControl(); };
+	ioTable[0x204].write16 = [](memory* mem, uint32_t, uint16_t value) { mem->Waitstate->setControl(value); };
+}
+
+void memory::unhandledIO(uint32_t addr, bool write)
+{
+	// Only the first access to each register is logged, the rest are counted.
+	if (ioUnhandledCount[addr & 0x3FF]++ == 0)
+	{
+		logging::error(std::string(write ? "Write to" : "Read from") + " unhandled I/O register: " + helpers::intToHex(addr), "memory");
+	}
+}
+
+void memory::setBackup(backup* Backup)
+{
+	this->Backup = Backup;
+}
+
+void memory::eepromRequest(uint32_t units)
+{
+	if (Backup != nullptr && Backup->isEEPROM())
+	{
+		static_cast<eeprom*>(Backup)->setRequestLength(units);
+	}
 }
 
 uint8_t memory::get8Cart(uint32_t addr)
@@ -37,7 +205,7 @@ uint8_t memory::get8Cart(uint32_t addr)
 	}
 }
 
-uint8_t memory::get8(uint32_t addr)
+uint8_t memory::read8(uint32_t addr)
 {
 	if (addr < 0x4000)
 	{
@@ -78,46 +246,7 @@ uint8_t memory::get8(uint32_t addr)
 	else if (addr < 0x04000400)
 	{
 		// IO area
-		if (addr < 0x04000060)
-		{
-			return GPU->getRegister(addr);
-		}
-		else if (addr < 0x40000B0)
-		{
-			logging::error("Tried to read from sound register: " + helpers::intToHex(addr), "memory");
-			return 0;
-		}
-		else if (addr < 0x4000100)
-		{
-			return DMA->getRegister(addr);
-		}
-		else if (addr < 0x4000120)
-		{
-			return Timers->getRegister(addr);
-		}
-		else if (addr < 0x4000130)
-		{
-			logging::error("Tried to read from serial area 1: " + helpers::intToHex(addr), "memory");
-			return 0;
-		}
-		else if (addr < 0x4000134)
-		{
-			return Input->getRegister(addr);
-		}
-		else if (addr < 0x4000200)
-		{
-			logging::error("Tried to read from serial area 2: " + helpers::intToHex(addr), "memory");
-			return 0;
-		}
-		else if (addr < 0x4000804)
-		{
-			return Interrupt->getRegister(addr);
-		}
-		else
-		{
-			logging::error("Tried to read from unused I/O area: " + helpers::intToHex(addr), "memory");
-			return 0;
-		}
+		return ioTable[addr - 0x04000000].read8(this, addr);
 	}
 	else if (addr < 0x05000000)
 	{
@@ -142,11 +271,19 @@ uint8_t memory::get8(uint32_t addr)
 	else if (addr < 0x0E000000)
 	{
 		//ROM Wait State 2
+		if (addr >= eepromStart && Backup != nullptr && Backup->isEEPROM())
+		{
+			return Backup->read8(addr);
+		}
 		return get8Cart(addr - 0x0C000000);
 	}
-	else if (addr < 0x0E010000)
+	else if (addr < 0x10000000)
 	{
-		//Cart SRAM
+		//Cart SRAM / Flash
+		if (Backup != nullptr && !Backup->isEEPROM())
+		{
+			return Backup->read8(addr);
+		}
 		logging::warning("Tried to read from Cart SRAM: " + helpers::intToHex(addr), "memory");
 		return 0;
 	}
@@ -160,17 +297,34 @@ uint8_t memory::get8(uint32_t addr)
 	return 0;
 }
 
-uint16_t memory::get16(uint32_t addr)
+uint16_t memory::read16(uint32_t addr)
 {
-	return (((uint16_t)get8(addr + 1)) << 8) | get8(addr);
+	if (addr >= 0x04000000 && addr < 0x04000400 && !(addr & 0x1))
+	{
+		const ioHandler& handler = ioTable[addr - 0x04000000];
+		if (handler.read16 != nullptr)
+		{
+			return handler.read16(this, addr);
+		}
+	}
+	return (((uint16_t)read8(addr + 1)) << 8) | read8(addr);
 }
 
-uint32_t memory::get32(uint32_t addr)
+uint32_t memory::read32(uint32_t addr)
 {
-	return ((uint32_t)(get8(addr + 3) << 24) | ((uint32_t)get8(addr + 2) << 16) | ((uint32_t)get8(addr + 1) << 8) | get8(addr));
+	if (addr >= 0x04000000 && addr < 0x04000400 && !(addr & 0x3))
+	{
+		const ioHandler& handler = ioTable[addr - 0x04000000];
+		if (handler.read32 != nullptr)
+		{
+			return handler.read32(this, addr);
+		}
+		return read16(addr) | ((uint32_t)read16(addr + 2) << 16);
+	}
+	return ((uint32_t)(read8(addr + 3) << 24) | ((uint32_t)read8(addr + 2) << 16) | ((uint32_t)read8(addr + 1) << 8) | read8(addr));
 }
 
-void memory::set8(uint32_t addr, uint8_t value)
+void memory::write8(uint32_t addr, uint8_t value)
 {
 	if (addr < 0x4000)
 	{
@@ -202,42 +356,8 @@ void memory::set8(uint32_t addr, uint8_t value)
 	else if (addr < 0x04000400)
 	{
 		// IO area
-		if (addr < 0x04000060)
-		{
-			GPU->setRegister(addr, value);
-		}
-		else if (addr < 0x40000B0)
-		{
-			logging::error("Tried to set sound register: " + helpers::intToHex(addr), "memory");
-		}
-		else if (addr < 0x4000100)
-		{
-			DMA->setRegister(addr, value);
-		}
-		else if (addr < 0x4000120)
-		{
-			Timers->setRegister(addr, value);
-		}
-		else if (addr < 0x4000130)
-		{
-			logging::error("Tried to set serial area 1: " + helpers::intToHex(addr), "memory");
-		}
-		else if (addr < 0x4000134)
-		{
-			Input->setRegister(addr, value);
-		}
-		else if (addr < 0x4000200)
-		{
-			logging::error("Tried to set serial area 2: " + helpers::intToHex(addr), "memory");
-		}
-		else if (addr < 0x4000804)
-		{
-			Interrupt->setRegister(addr, value);
-		}
-		else
-		{
-			logging::error("Tried to set unused I/O area: " + helpers::intToHex(addr), "memory");
-		}
+		io[addr - 0x04000000] = value;
+		ioTable[addr - 0x04000000].write8(this, addr, value);
 	}
 	else if (addr < 0x05000000)
 	{
@@ -261,12 +381,26 @@ void memory::set8(uint32_t addr, uint8_t value)
 	else if (addr < 0x0E000000)
 	{
 		//ROM Wait State 2
-		logging::error("Tried to write to Cart ROM: " + helpers::intToHex(addr), "memory");
+		if (addr >= eepromStart && Backup != nullptr && Backup->isEEPROM())
+		{
+			Backup->write8(addr, value);
+		}
+		else
+		{
+			logging::error("Tried to write to Cart ROM: " + helpers::intToHex(addr), "memory");
+		}
 	}
-	else if (addr < 0E010000)
+	else if (addr < 0x10000000)
 	{
-		//Cart SRAM
-		logging::warning("Tried to write to Cart SRAM: " + helpers::intToHex(addr), "memory");
+		//Cart SRAM / Flash
+		if (Backup != nullptr && !Backup->isEEPROM())
+		{
+			Backup->write8(addr, value);
+		}
+		else
+		{
+			logging::warning("Tried to write to Cart SRAM: " + helpers::intToHex(addr), "memory");
+		}
 	}
 	else if (addr < 0xFFFFFFFF)
 	{
@@ -275,16 +409,187 @@ void memory::set8(uint32_t addr, uint8_t value)
 	}
 }
 
+void memory::write16(uint32_t addr, uint16_t value)
+{
+	if (addr >= 0x04000000 && addr < 0x04000400 && !(addr & 0x1))
+	{
+		const ioHandler& handler = ioTable[addr - 0x04000000];
+		if (handler.write16 != nullptr)
+		{
+			memcpy(io + (addr - 0x04000000), &value, 2);
+			handler.write16(this, addr, value);
+			return;
+		}
+	}
+	write8(addr, value & 0xFF);
+	write8(addr + 1, value >> 8);
+}
+
+void memory::write32(uint32_t addr, uint32_t value)
+{
+	if (addr >= 0x04000000 && addr < 0x04000400 && !(addr & 0x3))
+	{
+		const ioHandler& handler = ioTable[addr - 0x04000000];
+		if (handler.write32 != nullptr)
+		{
+			memcpy(io + (addr - 0x04000000), &value, 4);
+			handler.write32(this, addr, value);
+		}
+		else
+		{
+			write16(addr, value & 0xFFFF);
+			write16(addr + 2, value >> 16);
+		}
+		return;
+	}
+	write8(addr, value & 0xFF);
+	write8(addr + 1, (value >> 8) & 0xFF);
+	write8(addr + 2, (value >> 16) & 0xFF);
+	write8(addr + 3, (value >> 24) & 0xFF);
+}
+
+int memory::takeCycles()
+{
+	int cycles = cycleCount;
+	cycleCount = 0;
+	return cycles;
+}
+
+uint16_t memory::fetch16(uint32_t addr)
+{
+	cycleCount += Waitstate->opcodeFetch(addr, width16);
+	return read16(addr);
+}
+
+uint32_t memory::fetch32(uint32_t addr)
+{
+	cycleCount += Waitstate->opcodeFetch(addr, width32);
+	return read32(addr);
+}
+
+uint8_t memory::get8(uint32_t addr)
+{
+	cycleCount += Waitstate->dataAccess(addr, width8);
+	return read8(addr);
+}
+
+uint16_t memory::get16(uint32_t addr)
+{
+	cycleCount += Waitstate->dataAccess(addr, width16);
+	return read16(addr);
+}
+
+uint32_t memory::get32(uint32_t addr)
+{
+	cycleCount += Waitstate->dataAccess(addr, width32);
+	return read32(addr);
+}
+
+void memory::set8(uint32_t addr, uint8_t value)
+{
+	cycleCount += Waitstate->dataAccess(addr, width8);
+	write8(addr, value);
+}
+
 void memory::set16(uint32_t addr, uint16_t value)
 {
-	set8(addr, value & 0xFF);
-	set8(addr + 1, value >> 8);
+	cycleCount += Waitstate->dataAccess(addr, width16);
+	write16(addr, value);
 }
 
 void memory::set32(uint32_t addr, uint32_t value)
 {
-	set8(addr, value & 0xFF);
-	set8(addr + 1, (value >> 8) & 0xFF);
-	set8(addr + 2, (value >> 16) & 0xFF);
-	set8(addr + 3, (value >> 24) & 0xFF);
+	cycleCount += Waitstate->dataAccess(addr, width32);
+	write32(addr, value);
+}
+
+// Returns a host pointer to [addr, addr + length) if it's all in one block of plain memory,
+// or nullptr if any of it needs the full address decoder (I/O, save memory, mirrors of video memory).
+uint8_t* memory::directPointer(uint32_t addr, uint32_t length, bool write)
+{
+	uint8_t* base;
+	uint32_t size;
+	uint32_t offset;
+	switch (addr >> 24)
+	{
+		case 0x2: base = ewram; size = 0x40000; offset = addr & 0x3FFFF; break;
+		case 0x3: base = iwram; size = 0x8000; offset = addr & 0x7FFF; break;
+		case 0x5: base = paletteRAM; size = 0x400; offset = addr - 0x05000000; break;
+		case 0x6: base = vram; size = 0x18000; offset = addr - 0x06000000; break;
+		case 0x7: base = objectRAM; size = 0x400; offset = addr - 0x07000000; break;
+		case 0x8: case 0x9: case 0xA: case 0xB: case 0xC: case 0xD:
+			if (write || (addr + length > eepromStart && Backup != nullptr && Backup->isEEPROM()))
+			{
+				return nullptr;
+			}
+			base = cartrom;
+			size = romSize;
+			offset = addr & 0x1FFFFFF;
+			break;
+		default:
+			return nullptr;
+	}
+	if (offset >= size || length > size - offset)
+	{
+		return nullptr;
+	}
+	return base + offset;
+}
+
+/* DMA between plain memory regions skips the address decoder and copies in one go.
+Handles incrementing destinations with an incrementing or fixed source.
+Returns false if the transfer has to go through get/set one unit at a time.
+DMA works out its own cycle cost, so this doesn't add any. */
+bool memory::dmaTransfer(uint32_t dst, uint32_t src, uint32_t units, int width, bool fixedSource)
+{
+	uint32_t unitSize = 1 << width;
+	if ((src | dst) & (unitSize - 1))
+	{
+		return false;
+	}
+	uint32_t length = units * unitSize;
+	uint8_t* source = directPointer(src, fixedSource ? unitSize : length, false);
+	uint8_t* dest = directPointer(dst, length, true);
+	if (source == nullptr || dest == nullptr)
+	{
+		return false;
+	}
+	if (!fixedSource && source < dest + length && dest < source + length)
+	{
+		return false; // Overlapping copies have to happen a unit at a time, in order
+	}
+	bool videoMemory = (dst >> 24) >= 0x5 && (dst >> 24) <= 0x7;
+	if (videoMemory && !fixedSource && memcmp(dest, source, length) == 0)
+	{
+		return true; // Copying the same data again (like OAM every frame) doesn't change the screen
+	}
+	if (fixedSource)
+	{
+		uint32_t value = 0;
+		memcpy(&value, source, unitSize);
+		if (unitSize == 2 && (value & 0xFF) == (value >> 8))
+		{
+			memset(dest, value & 0xFF, length);
+		}
+		else if (unitSize == 4 && value == (value & 0xFF) * 0x01010101)
+		{
+			memset(dest, value & 0xFF, length);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < length; i += unitSize)
+			{
+				memcpy(dest + i, &value, unitSize);
+			}
+		}
+	}
+	else
+	{
+		memcpy(dest, source, length);
+	}
+	if (videoMemory)
+	{
+		GPU->videoMemoryWritten(dst, length);
+	}
+	return true;
 }
\ No newline at end of file
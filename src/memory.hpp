@@ -5,6 +5,24 @@
 #include "interrupt.hpp"
 #include "timer.hpp"
 #include "dma.hpp"
+#include "sound.hpp"
+#include "waitstate.hpp"
+#include "backup.hpp"
+#include "arena.hpp"
+
+class memory;
+
+// Handlers for a single I/O register address. Each width is optional:
+// a missing 16 or 32 bit handler falls back to the narrower ones.
+struct ioHandler
+{
+	uint8_t (*read8)(memory* mem, uint32_t addr);
+	uint16_t (*read16)(memory* mem, uint32_t addr);
+	uint32_t (*read32)(memory* mem, uint32_t addr);
+	void (*write8)(memory* mem, uint32_t addr, uint8_t value);
+	void (*write16)(memory* mem, uint32_t addr, uint16_t value);
+	void (*write32)(memory* mem, uint32_t addr, uint32_t value);
+};
 
 class memory
 {
@@ -12,6 +30,10 @@ class memory
 		uint8_t* bios;
 		uint8_t* iwram;
 		uint8_t* ewram;
+		uint8_t* io;
+		uint8_t* paletteRAM;
+		uint8_t* vram;
+		uint8_t* objectRAM;
 		uint8_t* cartrom;
 		uint32_t romSize;
 		gpu* GPU;
@@ -19,14 +41,36 @@ class memory
 		interrupt* Interrupt;
 		timers* Timers;
 		dma* DMA;
+		sound* Sound;
+		waitstate* Waitstate;
+		backup* Backup;
+		uint32_t eepromStart;
+		int cycleCount;
+		ioHandler ioTable[0x400];
+		uint32_t ioUnhandledCount[0x400];
 		uint8_t get8Cart(uint32_t addr);
+		uint8_t read8(uint32_t addr);
+		uint16_t read16(uint32_t addr);
+		uint32_t read32(uint32_t addr);
+		void write8(uint32_t addr, uint8_t value);
+		void write16(uint32_t addr, uint16_t value);
+		void write32(uint32_t addr, uint32_t value);
+		void buildIOTable();
+		void unhandledIO(uint32_t addr, bool write);
+		uint8_t* directPointer(uint32_t addr, uint32_t length, bool write);
 	public:
-		memory(uint8_t* rom, uint32_t romSize, uint8_t* bios, gpu* GPU, input* Input, interrupt* Interrupt, timers* Timers, dma* DMA);
+		memory(uint8_t* rom, uint32_t romSize, memoryArena* Arena, bool biosLoaded, gpu* GPU, input* Input, interrupt* Interrupt, timers* Timers, dma* DMA, sound* Sound, waitstate* Waitstate);
 		~memory();
+		void setBackup(backup* Backup);
+		void eepromRequest(uint32_t units);
+		int takeCycles();
+		uint16_t fetch16(uint32_t addr);
+		uint32_t fetch32(uint32_t addr);
 		uint8_t get8(uint32_t addr);
 		uint16_t get16(uint32_t addr);
 		uint32_t get32(uint32_t addr);
 		void set8(uint32_t addr, uint8_t value);
 		void set16(uint32_t addr, uint16_t value);
 		void set32(uint32_t addr, uint32_t value);
+		bool dmaTransfer(uint32_t dst, uint32_t src, uint32_t units, int width, bool fixedSource);
 };
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "objects.hpp"
+#include <cstring>
+
+/* OBJ Attribute 0 (R/W)
+  Bit   Expl.
+  0-7   Y-Coordinate           (0-255)
+  8     Rotation/Scaling Flag  (0=Off, 1=On)
+  9     When Rotation/Scaling used (Attribute 0, bit 8 set):
+          Double-Size Flag     (0=Normal, 1=Double)
+        When Rotation/Scaling not used (Attribute 0, bit 8 cleared):
+          OBJ Disable          (0=Normal, 1=Not displayed)
+  10-11 OBJ Mode  (0=Normal, 1=Semi-Transparent, 2=OBJ Window, 3=Prohibited)
+  12    OBJ Mosaic             (0=Off, 1=On)
+  13    Colors/Palettes        (0=16/16, 1=256/1)
+  14-15 OBJ Shape              (0=Square,1=Horizontal,2=Vertical,3=Prohibited)
+
+OBJ Attribute 1 (R/W)
+  Bit   Expl.
+  0-8   X-Coordinate           (0-511)
+  9-13  Rotation/Scaling Parameter Selection (0-31) (when bit 8 of Attribute 0 is set)
+  12    Horizontal Flip        (0=Normal, 1=Mirrored) (when bit 8 of Attribute 0 is cleared)
+  13    Vertical Flip          (0=Normal, 1=Mirrored) (when bit 8 of Attribute 0 is cleared)
+  14-15 OBJ Size               (0..3, depends on OBJ Shape, see Attr 0)
+
+OBJ Attribute 2 (R/W)
+  Bit   Expl.
+  0-9   Character Name          (0-1023=Tile Number)
+  10-11 Priority relative to BG (0-3; 0=Highest)
+  12-15 Palette Number   (0-15) (Not used in 256 color/1 palette mode) */
+
+// Width and height in pixels for each shape and size
+static const uint8_t objectSizes[3][4][2] = {
+	{ { 8, 8 }, { 16, 16 }, { 32, 32 }, { 64, 64 } }, // Square
+	{ { 16, 8 }, { 32, 8 }, { 32, 16 }, { 64, 32 } }, // Horizontal
+	{ { 8, 16 }, { 8, 32 }, { 16, 32 }, { 32, 64 } } // Vertical
+};
+
+objectList::objectList(const uint8_t* objectRAM)
+{
+	this->objectRAM = objectRAM;
+	memset(objects, 0, sizeof(objects));
+	memset(affineGroups, 0, sizeof(affineGroups));
+	memset(lineObjectCount, 0, sizeof(lineObjectCount));
+	dirty = true;
+}
+
+void objectList::update()
+{
+	if (dirty)
+	{
+		rebuild();
+		dirty = false;
+	}
+}
+
+void objectList::rebuild()
+{
+	memset(lineObjectCount, 0, sizeof(lineObjectCount));
+	// Group n's PA, PB, PC and PD are at offsets 0x06, 0x0E, 0x16 and 0x1E of the n * 0x20 byte block
+	for (int i = 0; i < 32; i++)
+	{
+		const uint8_t* group = objectRAM + (i * 32);
+		affineGroups[i].pa = (int16_t)(group[0x06] | (group[0x07] << 8));
+		affineGroups[i].pb = (int16_t)(group[0x0E] | (group[0x0F] << 8));
+		affineGroups[i].pc = (int16_t)(group[0x16] | (group[0x17] << 8));
+		affineGroups[i].pd = (int16_t)(group[0x1E] | (group[0x1F] << 8));
+	}
+	for (int i = 0; i < 128; i++)
+	{
+		const uint8_t* entry = objectRAM + (i * 8);
+		uint16_t attr0 = entry[0] | ((uint16_t)entry[1] << 8);
+		uint16_t attr1 = entry[2] | ((uint16_t)entry[3] << 8);
+		uint16_t attr2 = entry[4] | ((uint16_t)entry[5] << 8);
+		objectAttributes& object = objects[i];
+
+		object.y = attr0 & 0xFF;
+		object.affine = attr0 & 0x100;
+		object.doubleSize = object.affine && (attr0 & 0x200);
+		object.mode = (attr0 >> 10) & 0x3;
+		object.mosaic = attr0 & 0x1000;
+		object.colourDepth = attr0 & 0x2000;
+		object.x = (attr1 & 0x100) ? (int16_t)(attr1 & 0x1FF) - 512 : attr1 & 0xFF;
+		object.affineGroup = (attr1 >> 9) & 0x1F;
+		object.hFlip = !object.affine && (attr1 & 0x1000);
+		object.vFlip = !object.affine && (attr1 & 0x2000);
+		object.tile = attr2 & 0x3FF;
+		object.priority = (attr2 >> 10) & 0x3;
+		object.palette = attr2 >> 12;
+
+		int shape = attr0 >> 14;
+		bool hidden = (!object.affine && (attr0 & 0x200)) || object.mode == 3 || shape == 3;
+		if (hidden)
+		{
+			object.width = 0;
+			object.height = 0;
+			continue;
+		}
+		object.width = objectSizes[shape][attr1 >> 14][0];
+		object.height = objectSizes[shape][attr1 >> 14][1];
+
+		// Y wraps at 256, so objects near the bottom of that range show at the top of the screen
+		int boundsHeight = object.doubleSize ? object.height * 2 : object.height;
+		for (int row = 0; row < boundsHeight; row++)
+		{
+			int line = (object.y + row) & 0xFF;
+			if (line < 160)
+			{
+				lineObjects[line][lineObjectCount[line]++] = i;
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+// One OAM entry, unpacked from its three attribute halfwords
+struct objectAttributes
+{
+	int16_t x; // -256 to 255
+	uint8_t y;
+	uint8_t width;
+	uint8_t height;
+	bool affine;
+	bool doubleSize;
+	uint8_t mode; // 0 = Normal, 1 = Semi-Transparent, 2 = OBJ Window
+	bool mosaic;
+	bool colourDepth; // 0 = 16 colours, 16 palettes. 1 = 256 colours, 1 palette.
+	bool hFlip;
+	bool vFlip;
+	uint8_t affineGroup;
+	uint16_t tile;
+	uint8_t priority;
+	uint8_t palette;
+};
+
+// One of the 32 rotation/scaling parameter groups, which are spread over the unused
+// fourth halfword of four OAM entries. 8.8 fixed point, like the BG matrices.
+struct objectAffine
+{
+	int16_t pa;
+	int16_t pb;
+	int16_t pc;
+	int16_t pd;
+};
+
+/* The unpacked OAM entries, and for each scanline a list of the ones that appear on it.
+Both are only rebuilt when OAM has changed, which gpu signals with invalidate.
+update has to be called before drawing, after OAM writes have been applied. */
+class objectList
+{
+	private:
+		const uint8_t* objectRAM;
+		bool dirty;
+		objectAttributes objects[128];
+		objectAffine affineGroups[32];
+		uint8_t lineObjects[160][128]; // OAM indices, lowest first
+		uint8_t lineObjectCount[160];
+
+		void rebuild();
+	public:
+		objectList(const uint8_t* objectRAM);
+		void invalidate() { dirty = true; }
+		void update();
+		const objectAttributes& getObject(int index) { return objects[index]; }
+		const objectAffine& getAffineGroup(int index) { return affineGroups[index]; }
+		const uint8_t* getLineObjects(int line) { return lineObjects[line]; }
+		int getLineObjectCount(int line) { return lineObjectCount[line]; }
+};
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "palette.hpp"
+
+/*
+0 - 4   Red Intensity(0 - 31)
+5 - 9   Green Intensity(0 - 31)
+10 - 14 Blue Intensity(0 - 31)
+15    Not used
+*/
+static uint32_t toHostColour(uint16_t colour, bool swapRedBlue)
+{
+	uint32_t red = (colour & 0x1F) << 3;
+	uint32_t green = ((colour >> 5) & 0x1F) << 3;
+	uint32_t blue = ((colour >> 10) & 0x1F) << 3;
+	if (swapRedBlue)
+	{
+		return 0xFF000000 | (blue << 16) | (green << 8) | red;
+	}
+	return 0xFF000000 | (red << 16) | (green << 8) | blue;
+}
+
+paletteCache::paletteCache(const uint8_t* paletteRAM, bool swapRedBlue)
+{
+	this->paletteRAM = paletteRAM;
+	for (int colour = 0; colour < 0x8000; colour++)
+	{
+		directColours[colour] = toHostColour(colour, swapRedBlue);
+	}
+	update(0, 0x400);
+}
+
+// Reconverts the entries overlapping palette RAM [offset, offset + length)
+void paletteCache::update(uint32_t offset, uint32_t length)
+{
+	uint32_t end = offset + length;
+	if (end > 0x400)
+	{
+		end = 0x400;
+	}
+	for (uint32_t entry = offset / 2; entry * 2 < end; entry++)
+	{
+		uint16_t colour = paletteRAM[entry * 2] | ((uint16_t)paletteRAM[(entry * 2) + 1] << 8);
+		bgrColours[entry] = colour & 0x7FFF;
+		colours[entry] = directColours[bgrColours[entry]];
+	}
+}
\ No newline at end of file
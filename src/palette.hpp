@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+/* Palette RAM converted to the host's pixel format, ARGB8888 or ABGR8888.
+Each entry is converted when it's written rather than each time it's drawn.
+Direct colour pixels (modes 3 and 5) go through a table covering every BGR555 colour.
+The BGR555 values are kept as well, for colour effects to work on. */
+class paletteCache
+{
+	private:
+		const uint8_t* paletteRAM;
+		uint32_t colours[512];
+		uint16_t bgrColours[512];
+		uint32_t directColours[0x8000];
+	public:
+		paletteCache(const uint8_t* paletteRAM, bool swapRedBlue);
+		void update(uint32_t offset, uint32_t length);
+		const uint32_t* getColours() { return colours; }
+		const uint32_t* getDirectColours() { return directColours; }
+		const uint16_t* getBGRColours() { return bgrColours; }
+};
\ No newline at end of file
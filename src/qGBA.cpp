@@ -7,10 +7,39 @@
 #include "interrupt.hpp"
 #include "timer.hpp"
 #include "dma.hpp"
+#include "sound.hpp"
+#include "waitstate.hpp"
+#include "backup.hpp"
+#include "arena.hpp"
+#include "scheduler.hpp"
+#include "threadpool.hpp"
 #include "SDL.h"
+#include <algorithm>
 
 int main(int argc, char** argv)
 {
+	//Options can go anywhere. Everything else is the ROM and BIOS paths, in that order.
+	bool saveTypeGiven = false;
+	backupType saveType = backupType::None;
+	int pathCount = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--save-type")
+		{
+			if (i + 1 >= argc || !backup::parseType(argv[i + 1], &saveType))
+			{
+				logging::fatal("--save-type needs one of: none, sram, flash64k, flash128k, eeprom, eeprom4k, eeprom64k", "qGBA");
+			}
+			saveTypeGiven = true;
+			i++;
+		}
+		else
+		{
+			argv[pathCount++] = argv[i];
+		}
+	}
+	argc = pathCount;
+
 	//Read the ROM file
 	if (argc < 2)
 	{
@@ -31,9 +60,12 @@ int main(int argc, char** argv)
 	fclose(romFile);
 	logging::info("Opened ROM: " + std::string(argv[1]), "qGBA");
 
+	//All emulated memory, including the BIOS, goes in one block
+	memoryArena Arena(true);
+
 	//Read the BIOS file
-	uint8_t* bios = nullptr;
-	if (argc > 2)
+	bool biosGiven = argc > 2;
+	if (biosGiven)
 	{
 		FILE* biosFile = fopen(argv[2], "rb");
 		if (!biosFile)
@@ -49,8 +81,7 @@ int main(int argc, char** argv)
 			logging::fatal("BIOS file is incorrect size: " + std::to_string(biosSize) + " bytes");
 		}
 		//Copy the bios into memory
-		bios = new uint8_t[biosSize];
-		fread(bios, biosSize, 1, biosFile);
+		fread(Arena.getBIOS(), biosSize, 1, biosFile);
 		fclose(biosFile);
 		logging::info("Opened BIOS: " + std::string(argv[2]), "qGBA");
 	}
@@ -107,7 +138,12 @@ int main(int argc, char** argv)
 		gameName += (char)rom[0xA0 + i];
 	}
 	logging::info("Game name: " + gameName, "qGBA");
-	logging::info(std::string("Game code: ") + (char)rom[0xAC] + (char)rom[0xAD] + (char)rom[0xAE] + (char)rom[0xAF], "qGBA");
+	std::string gameCode = "";
+	for (int i = 0; i < 4; i++)
+	{
+		gameCode += (char)rom[0xAC + i];
+	}
+	logging::info("Game code: " + gameCode, "qGBA");
 	logging::info(std::string("Maker code: ") + (char)rom[0xB0] + (char)rom[0xB1], "qGBA");
 	if (rom[0xB2] != 0x96)
 	{
@@ -134,25 +170,71 @@ int main(int argc, char** argv)
 	//0xBE and 0xBF - Reserved space (All 0). Doesn't matter.
 	//Rest of the header only matters for multiboot.
 
+	//The save file goes next to the ROM, with the extension swapped for .sav
+	std::string romPath = argv[1];
+	size_t extensionPos = romPath.find_last_of('.');
+	size_t separatorPos = romPath.find_last_of("/\\");
+	if (extensionPos != std::string::npos && (separatorPos == std::string::npos || extensionPos > separatorPos))
+	{
+		romPath = romPath.substr(0, extensionPos);
+	}
+	std::string savePath = romPath + ".sav";
+
+	//A save type from the command line beats the override table and the ROM scan.
+	//A scanned type is cached in a .savetype file, which is only trusted if the header still matches.
+	std::string saveTypeCachePath = romPath + ".savetype";
+	std::string headerKey = "";
+	for (char c : gameCode)
+	{
+		headerKey += (c >= ' ' && c <= '~') ? c : '_'; // Homebrew often leaves the code blank
+	}
+	headerKey += " " + helpers::intToHex(rom[0xBD]) + " " + std::to_string(romSize);
+	if (saveTypeGiven)
+	{
+		logging::info("Save type: " + backup::typeName(saveType) + " (command line)", "qGBA");
+	}
+	else if (backup::overrideType(gameCode, &saveType))
+	{
+		logging::info("Save type: " + backup::typeName(saveType) + " (override)", "qGBA");
+	}
+	else if (backup::loadCachedType(saveTypeCachePath, headerKey, &saveType))
+	{
+		logging::info("Save type: " + backup::typeName(saveType) + " (cached)", "qGBA");
+	}
+	else
+	{
+		saveType = backup::detectType(rom, romSize);
+		logging::info("Save type: " + backup::typeName(saveType), "qGBA");
+		backup::saveCachedType(saveTypeCachePath, headerKey, saveType);
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_AUDIO) != 0)
 	{
 		logging::fatal("SDL Init Error: " + std::string(SDL_GetError()));
 	}
-	bool biosGiven = bios != nullptr;
 
 	bool requestIRQ = false;
 	bool CPUHalt = false;
+	scheduler Scheduler;
 	interrupt Interrupt(&requestIRQ, &CPUHalt);
-	dma DMA(&Interrupt);
-	timers Timers(&Interrupt);
-	gpu GPU(&Interrupt, &DMA);
+	waitstate Waitstate;
+	dma DMA(&Interrupt, &Scheduler, &Waitstate);
+	sound Sound(&DMA);
+	timers Timers(&Interrupt, &Scheduler, &Sound);
+	// Scanlines get drawn on a few threads. With only 160 of them, more than 4 doesn't help.
+	int threadCount = std::max(1, std::min((int)std::thread::hardware_concurrency(), 4));
+	threadPool Pool(threadCount);
+	gpu GPU(&Interrupt, &DMA, &Arena, &Scheduler, &Pool);
 	input Input(&Interrupt);
-	memory mem(rom, romSize, bios, &GPU, &Input, &Interrupt, &Timers, &DMA);
+	memory mem(rom, romSize, &Arena, biosGiven, &GPU, &Input, &Interrupt, &Timers, &DMA, &Sound, &Waitstate);
 	arm7tdmi CPU(&mem, biosGiven, &requestIRQ, &CPUHalt);
 	DMA.setMemory(&mem);
+	backup* Backup = backup::create(saveType, savePath);
+	mem.setBackup(Backup);
 
 	bool quit = false;
 	SDL_Event event;
+	uint64_t frameEnd = 0;
 
 	while(!quit)
 	{
@@ -177,20 +259,26 @@ int main(int argc, char** argv)
 				}
 			}
 		}
-		for (int i = 0; i < 280896; i++) // Run for one frame
+		frameEnd += 280896; // Run for one frame
+		while (Scheduler.getNow() < frameEnd)
 		{
-			CPU.step();
-			GPU.step(1);
-			Timers.step(1);
-			DMA.step(1);
+			// Run the CPU up to the next event, then let the events fire
+			while (Scheduler.getNow() < Scheduler.getNextEventTime() && Scheduler.getNow() < frameEnd)
+			{
+				if (CPUHalt)
+				{
+					// Only an event can wake a halted CPU, so skip straight to the next one
+					Scheduler.addCycles(std::min(Scheduler.getNextEventTime(), frameEnd) - Scheduler.getNow());
+					break;
+				}
+				Scheduler.addCycles(CPU.step());
+			}
+			Scheduler.runEvents();
 		}
 	}
 
+	delete Backup;
 	SDL_Quit();
-	if (bios != nullptr)
-	{
-		delete[] bios;
-	}
 	delete[] rom;
 	logging::info("Exited successfully", "qGBA");
 	return 0;
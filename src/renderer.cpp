@@ -0,0 +1,1172 @@
+#include "renderer.hpp"
+#include "simd.hpp"
+#include <cstring>
+
+/* Text BG Screen (2 bytes per entry)
+  Bit   Expl.
+  0-9   Tile Number     (0-1023) (a bit less in 256 color mode, because
+                          there'd be otherwise no room for the bg map)
+  10    Horizontal Flip (0=Normal, 1=Mirrored)
+  11    Vertical Flip   (0=Normal, 1=Mirrored)
+  12-15 Palette Number  (0-15)    (Not used in 256 color/1 palette mode)
+
+Each BG is drawn a tile at a time: the map entry is read once, then a whole
+8 pixel row of the tile is fetched as one 64 bit value and spread into the layer's line buffer. */
+
+constexpr uint32_t bgVRAMSize = 0x10000; // BG tiles can't come from OBJ VRAM
+constexpr uint32_t objVRAMBase = 0x10000;
+constexpr uint16_t objPaletteBase = 256;
+
+/* The layers are painted from back to front, each one replacing the pixels
+underneath wherever it isn't transparent. That's a select per pixel with no
+branches, so the vector versions do 8 or 16 pixels at a time. */
+static void mergeScalar(const uint16_t* const* layers, int layerCount, uint16_t* out, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		uint16_t entry = 0; // Nothing opaque shows the backdrop, which is palette entry 0
+		for (int i = 0; i < layerCount; i++)
+		{
+			uint16_t pixel = layers[i][x];
+			entry = pixel ? pixel : entry;
+		}
+		out[x] = entry;
+	}
+}
+
+#ifdef QGBA_X86
+static void mergeSSE2(const uint16_t* const* layers, int layerCount, uint16_t* out, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	for (int x = 0; x < width; x += 8)
+	{
+		__m128i entry = zero;
+		for (int i = 0; i < layerCount; i++)
+		{
+			__m128i pixel = _mm_loadu_si128((const __m128i*)(layers[i] + x));
+			__m128i transparent = _mm_cmpeq_epi16(pixel, zero);
+			entry = _mm_or_si128(_mm_and_si128(transparent, entry), pixel);
+		}
+		_mm_storeu_si128((__m128i*)(out + x), entry);
+	}
+}
+
+QGBA_TARGET_AVX2 static void mergeAVX2(const uint16_t* const* layers, int layerCount, uint16_t* out, int width)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	for (int x = 0; x < width; x += 16)
+	{
+		__m256i entry = zero;
+		for (int i = 0; i < layerCount; i++)
+		{
+			__m256i pixel = _mm256_loadu_si256((const __m256i*)(layers[i] + x));
+			__m256i transparent = _mm256_cmpeq_epi16(pixel, zero);
+			entry = _mm256_or_si256(_mm256_and_si256(transparent, entry), pixel);
+		}
+		_mm256_storeu_si256((__m256i*)(out + x), entry);
+	}
+}
+#endif
+
+constexpr uint16_t objLayerBit = 0x10;
+constexpr uint16_t backdropBit = 0x20;
+constexpr uint16_t effectsBit = 0x20; // In windowMask
+constexpr uint16_t semiTransparentBit = 0x40; // Marks a semi-transparent OBJ pixel in topLayer
+constexpr uint16_t blendedColour = 0x8000; // Blended pixels come out as direct colour entries
+
+/* Tracks the top two pixels with the same selects as merge, so masking with the windows
+only costs an extra and and compare per layer. Before anything is painted the backdrop
+is on top, with nothing underneath it. */
+static void mergeTargetsScalar(const uint16_t* const* layers, const uint16_t* layerBits, int layerCount, const uint16_t* windowMask, layerTargets& targets, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		uint16_t top = 0;
+		uint16_t topLayer = backdropBit;
+		uint16_t second = 0;
+		uint16_t secondLayer = 0;
+		for (int i = 0; i < layerCount; i++)
+		{
+			uint16_t pixel = layers[i][x];
+			if (pixel != 0 && (windowMask[x] & layerBits[i]))
+			{
+				second = top;
+				secondLayer = topLayer;
+				top = pixel;
+				topLayer = layerBits[i];
+			}
+		}
+		targets.top[x] = top;
+		targets.topLayer[x] = topLayer;
+		targets.second[x] = second;
+		targets.secondLayer[x] = secondLayer;
+	}
+}
+
+/* Alpha blending mixes the top two colours by EVA / 16 and EVB / 16, capped at 31.
+The brightness effects move the top colour EVY / 16 of the way to white or black.
+A semi-transparent OBJ pixel is always alpha blended if the pixel under it is a second target,
+whatever BLDCNT's effect is, and then no brightness change is made. */
+static void blendScalar(const layerTargets& targets, const blendSettings& settings, uint16_t* out, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		uint16_t top = targets.top[x];
+		bool first = targets.topLayer[x] & settings.firstTargets;
+		bool second = targets.secondLayer[x] & settings.secondTargets;
+		bool alpha = second && ((targets.topLayer[x] & semiTransparentBit) || (first && settings.alpha));
+		bool brightness = !alpha && first && settings.brightness;
+		uint16_t colour = top;
+		if (alpha || brightness)
+		{
+			colour = 0;
+			for (int shift = 0; shift <= 10; shift += 5)
+			{
+				int channel = (top >> shift) & 0x1F;
+				if (alpha)
+				{
+					int below = (targets.second[x] >> shift) & 0x1F;
+					channel = ((channel * settings.firstWeight) + (below * settings.secondWeight)) >> 4;
+					channel = channel > 31 ? 31 : channel;
+				}
+				else if (settings.brighten)
+				{
+					channel += ((31 - channel) * settings.brightnessWeight) >> 4;
+				}
+				else
+				{
+					channel -= (channel * settings.brightnessWeight) >> 4;
+				}
+				colour |= channel << shift;
+			}
+		}
+		out[x] = blendedColour | colour;
+	}
+}
+
+#ifdef QGBA_X86
+static void mergeTargetsSSE2(const uint16_t* const* layers, const uint16_t* layerBits, int layerCount, const uint16_t* windowMask, layerTargets& targets, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	for (int x = 0; x < width; x += 8)
+	{
+		__m128i mask = _mm_loadu_si128((const __m128i*)(windowMask + x));
+		__m128i top = zero;
+		__m128i topLayer = _mm_set1_epi16(backdropBit);
+		__m128i second = zero;
+		__m128i secondLayer = zero;
+		for (int i = 0; i < layerCount; i++)
+		{
+			__m128i bit = _mm_set1_epi16(layerBits[i]);
+			__m128i pixel = _mm_loadu_si128((const __m128i*)(layers[i] + x));
+			__m128i shown = _mm_andnot_si128(_mm_cmpeq_epi16(pixel, zero), _mm_cmpeq_epi16(_mm_and_si128(mask, bit), bit));
+			second = _mm_or_si128(_mm_and_si128(shown, top), _mm_andnot_si128(shown, second));
+			secondLayer = _mm_or_si128(_mm_and_si128(shown, topLayer), _mm_andnot_si128(shown, secondLayer));
+			top = _mm_or_si128(_mm_and_si128(shown, pixel), _mm_andnot_si128(shown, top));
+			topLayer = _mm_or_si128(_mm_and_si128(shown, bit), _mm_andnot_si128(shown, topLayer));
+		}
+		_mm_storeu_si128((__m128i*)(targets.top + x), top);
+		_mm_storeu_si128((__m128i*)(targets.topLayer + x), topLayer);
+		_mm_storeu_si128((__m128i*)(targets.second + x), second);
+		_mm_storeu_si128((__m128i*)(targets.secondLayer + x), secondLayer);
+	}
+}
+
+// Works out both effects for all three channels of 8 pixels, then selects per pixel
+static void blendSSE2(const layerTargets& targets, const blendSettings& settings, uint16_t* out, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i allOnes = _mm_set1_epi16(-1);
+	const __m128i channelMask = _mm_set1_epi16(0x1F);
+	const __m128i firstTargets = _mm_set1_epi16(settings.firstTargets);
+	const __m128i secondTargets = _mm_set1_epi16(settings.secondTargets);
+	const __m128i semiTransparent = _mm_set1_epi16(semiTransparentBit);
+	const __m128i alphaEffect = settings.alpha ? allOnes : zero;
+	const __m128i brightnessEffect = settings.brightness ? allOnes : zero;
+	const __m128i firstWeight = _mm_set1_epi16(settings.firstWeight);
+	const __m128i secondWeight = _mm_set1_epi16(settings.secondWeight);
+	const __m128i brightnessWeight = _mm_set1_epi16(settings.brightnessWeight);
+	for (int x = 0; x < width; x += 8)
+	{
+		__m128i top = _mm_loadu_si128((const __m128i*)(targets.top + x));
+		__m128i below = _mm_loadu_si128((const __m128i*)(targets.second + x));
+		__m128i topLayer = _mm_loadu_si128((const __m128i*)(targets.topLayer + x));
+		__m128i secondLayer = _mm_loadu_si128((const __m128i*)(targets.secondLayer + x));
+		__m128i first = _mm_xor_si128(_mm_cmpeq_epi16(_mm_and_si128(topLayer, firstTargets), zero), allOnes);
+		__m128i second = _mm_xor_si128(_mm_cmpeq_epi16(_mm_and_si128(secondLayer, secondTargets), zero), allOnes);
+		__m128i semi = _mm_xor_si128(_mm_cmpeq_epi16(_mm_and_si128(topLayer, semiTransparent), zero), allOnes);
+		__m128i alpha = _mm_and_si128(second, _mm_or_si128(semi, _mm_and_si128(first, alphaEffect)));
+		__m128i brightness = _mm_andnot_si128(alpha, _mm_and_si128(first, brightnessEffect));
+
+		__m128i alphaColour = zero;
+		__m128i brightnessColour = zero;
+		for (int shift = 0; shift <= 10; shift += 5)
+		{
+			__m128i count = _mm_cvtsi32_si128(shift);
+			__m128i channel = _mm_and_si128(_mm_srl_epi16(top, count), channelMask);
+			__m128i belowChannel = _mm_and_si128(_mm_srl_epi16(below, count), channelMask);
+			__m128i mixed = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(channel, firstWeight), _mm_mullo_epi16(belowChannel, secondWeight)), 4);
+			alphaColour = _mm_or_si128(alphaColour, _mm_sll_epi16(_mm_min_epi16(mixed, channelMask), count));
+			__m128i changed = settings.brighten
+				? _mm_add_epi16(channel, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(channelMask, channel), brightnessWeight), 4))
+				: _mm_sub_epi16(channel, _mm_srli_epi16(_mm_mullo_epi16(channel, brightnessWeight), 4));
+			brightnessColour = _mm_or_si128(brightnessColour, _mm_sll_epi16(changed, count));
+		}
+		__m128i colour = _mm_or_si128(_mm_and_si128(brightness, brightnessColour), _mm_andnot_si128(brightness, top));
+		colour = _mm_or_si128(_mm_and_si128(alpha, alphaColour), _mm_andnot_si128(alpha, colour));
+		_mm_storeu_si128((__m128i*)(out + x), _mm_or_si128(colour, _mm_set1_epi16((int16_t)blendedColour)));
+	}
+}
+
+QGBA_TARGET_AVX2 static void mergeTargetsAVX2(const uint16_t* const* layers, const uint16_t* layerBits, int layerCount, const uint16_t* windowMask, layerTargets& targets, int width)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	for (int x = 0; x < width; x += 16)
+	{
+		__m256i mask = _mm256_loadu_si256((const __m256i*)(windowMask + x));
+		__m256i top = zero;
+		__m256i topLayer = _mm256_set1_epi16(backdropBit);
+		__m256i second = zero;
+		__m256i secondLayer = zero;
+		for (int i = 0; i < layerCount; i++)
+		{
+			__m256i bit = _mm256_set1_epi16(layerBits[i]);
+			__m256i pixel = _mm256_loadu_si256((const __m256i*)(layers[i] + x));
+			__m256i shown = _mm256_andnot_si256(_mm256_cmpeq_epi16(pixel, zero), _mm256_cmpeq_epi16(_mm256_and_si256(mask, bit), bit));
+			second = _mm256_blendv_epi8(second, top, shown);
+			secondLayer = _mm256_blendv_epi8(secondLayer, topLayer, shown);
+			top = _mm256_blendv_epi8(top, pixel, shown);
+			topLayer = _mm256_blendv_epi8(topLayer, bit, shown);
+		}
+		_mm256_storeu_si256((__m256i*)(targets.top + x), top);
+		_mm256_storeu_si256((__m256i*)(targets.topLayer + x), topLayer);
+		_mm256_storeu_si256((__m256i*)(targets.second + x), second);
+		_mm256_storeu_si256((__m256i*)(targets.secondLayer + x), secondLayer);
+	}
+}
+
+QGBA_TARGET_AVX2 static void blendAVX2(const layerTargets& targets, const blendSettings& settings, uint16_t* out, int width)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i allOnes = _mm256_set1_epi16(-1);
+	const __m256i channelMask = _mm256_set1_epi16(0x1F);
+	const __m256i firstTargets = _mm256_set1_epi16(settings.firstTargets);
+	const __m256i secondTargets = _mm256_set1_epi16(settings.secondTargets);
+	const __m256i semiTransparent = _mm256_set1_epi16(semiTransparentBit);
+	const __m256i alphaEffect = settings.alpha ? allOnes : zero;
+	const __m256i brightnessEffect = settings.brightness ? allOnes : zero;
+	const __m256i firstWeight = _mm256_set1_epi16(settings.firstWeight);
+	const __m256i secondWeight = _mm256_set1_epi16(settings.secondWeight);
+	const __m256i brightnessWeight = _mm256_set1_epi16(settings.brightnessWeight);
+	for (int x = 0; x < width; x += 16)
+	{
+		__m256i top = _mm256_loadu_si256((const __m256i*)(targets.top + x));
+		__m256i below = _mm256_loadu_si256((const __m256i*)(targets.second + x));
+		__m256i topLayer = _mm256_loadu_si256((const __m256i*)(targets.topLayer + x));
+		__m256i secondLayer = _mm256_loadu_si256((const __m256i*)(targets.secondLayer + x));
+		__m256i first = _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_and_si256(topLayer, firstTargets), zero), allOnes);
+		__m256i second = _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_and_si256(secondLayer, secondTargets), zero), allOnes);
+		__m256i semi = _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_and_si256(topLayer, semiTransparent), zero), allOnes);
+		__m256i alpha = _mm256_and_si256(second, _mm256_or_si256(semi, _mm256_and_si256(first, alphaEffect)));
+		__m256i brightness = _mm256_andnot_si256(alpha, _mm256_and_si256(first, brightnessEffect));
+
+		__m256i alphaColour = zero;
+		__m256i brightnessColour = zero;
+		for (int shift = 0; shift <= 10; shift += 5)
+		{
+			__m128i count = _mm_cvtsi32_si128(shift);
+			__m256i channel = _mm256_and_si256(_mm256_srl_epi16(top, count), channelMask);
+			__m256i belowChannel = _mm256_and_si256(_mm256_srl_epi16(below, count), channelMask);
+			__m256i mixed = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(channel, firstWeight), _mm256_mullo_epi16(belowChannel, secondWeight)), 4);
+			alphaColour = _mm256_or_si256(alphaColour, _mm256_sll_epi16(_mm256_min_epi16(mixed, channelMask), count));
+			__m256i changed = settings.brighten
+				? _mm256_add_epi16(channel, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(channelMask, channel), brightnessWeight), 4))
+				: _mm256_sub_epi16(channel, _mm256_srli_epi16(_mm256_mullo_epi16(channel, brightnessWeight), 4));
+			brightnessColour = _mm256_or_si256(brightnessColour, _mm256_sll_epi16(changed, count));
+		}
+		__m256i colour = _mm256_blendv_epi8(top, brightnessColour, brightness);
+		colour = _mm256_blendv_epi8(colour, alphaColour, alpha);
+		_mm256_storeu_si256((__m256i*)(out + x), _mm256_or_si256(colour, _mm256_set1_epi16((int16_t)blendedColour)));
+	}
+}
+#endif
+
+// Mosaic blocks start at the left edge of the screen
+static void mosaicScalar(uint16_t* line, int size, int width)
+{
+	for (int x = 0; x < width; x += size)
+	{
+		uint16_t pixel = line[x];
+		for (int i = 1; i < size && x + i < width; i++)
+		{
+			line[x + i] = pixel;
+		}
+	}
+}
+
+#ifdef QGBA_X86
+/* Every block's first pixel is read before anything is written. Then each block is filled
+with 8 wide stores from left to right, and a store that runs into the next block is
+overwritten by that block's own. 16 wide stores wouldn't help with blocks of at most 16. */
+static void mosaicSSE2(uint16_t* line, int size, int width)
+{
+	uint16_t firstPixels[240];
+	int blocks = 0;
+	for (int x = 0; x < width; x += size)
+	{
+		firstPixels[blocks++] = line[x];
+	}
+	for (int block = 0, x = 0; block < blocks; block++, x += size)
+	{
+		__m128i pixel = _mm_set1_epi16(firstPixels[block]);
+		for (int i = 0; i < size && x + i < width; i += 8)
+		{
+			_mm_storeu_si128((__m128i*)(line + x + i), pixel);
+		}
+	}
+}
+#endif
+
+/* Affine BG maps are 16 to 128 tiles square, one byte per entry holding just the
+tile number, and the tiles are always 8bpp. Each pixel's texture coordinate
+is the previous one plus (pa, pc). */
+struct affineLayout
+{
+	const uint8_t* vram;
+	uint32_t mapBaseAddr;
+	uint32_t tileBaseAddr;
+	int sizeShift; // log2 of the map's width in pixels
+	bool wrap;
+};
+
+static void affineScalar(const affineLayout& layout, const affineParams& params, uint16_t* out, int width)
+{
+	int32_t x = params.x;
+	int32_t y = params.y;
+	int32_t size = 1 << layout.sizeShift;
+	for (int i = 0; i < width; i++, x += params.pa, y += params.pc)
+	{
+		int32_t textureX = x >> 8;
+		int32_t textureY = y >> 8;
+		if (layout.wrap)
+		{
+			textureX &= size - 1;
+			textureY &= size - 1;
+		}
+		else if ((uint32_t)textureX >= (uint32_t)size || (uint32_t)textureY >= (uint32_t)size)
+		{
+			out[i] = 0;
+			continue;
+		}
+		uint8_t tile = layout.vram[layout.mapBaseAddr + ((textureY >> 3) << (layout.sizeShift - 3)) + (textureX >> 3)];
+		out[i] = layout.vram[layout.tileBaseAddr + (tile * 64) + ((textureY & 0x7) * 8) + (textureX & 0x7)];
+	}
+}
+
+#ifdef QGBA_X86
+// Steps 8 coordinates at a time and fetches the map entries and pixels with gathers.
+// The gathers read 4 bytes from each address and the low byte is kept.
+QGBA_TARGET_AVX2 static void affineAVX2(const affineLayout& layout, const affineParams& params, uint16_t* out, int width)
+{
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i stepX = _mm256_set1_epi32(params.pa * 8);
+	const __m256i stepY = _mm256_set1_epi32(params.pc * 8);
+	const __m256i sizeMask = _mm256_set1_epi32((1 << layout.sizeShift) - 1);
+	const __m256i byteMask = _mm256_set1_epi32(0xFF);
+	const __m256i mapBase = _mm256_set1_epi32(layout.mapBaseAddr);
+	const __m256i tileBase = _mm256_set1_epi32(layout.tileBaseAddr);
+	const __m128i sizeShift = _mm_cvtsi32_si128(layout.sizeShift - 3);
+	__m256i x = _mm256_add_epi32(_mm256_set1_epi32(params.x), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(params.pa)));
+	__m256i y = _mm256_add_epi32(_mm256_set1_epi32(params.y), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(params.pc)));
+	const int* vram = (const int*)layout.vram;
+
+	for (int i = 0; i < width; i += 8, x = _mm256_add_epi32(x, stepX), y = _mm256_add_epi32(y, stepY))
+	{
+		__m256i textureX = _mm256_srai_epi32(x, 8);
+		__m256i textureY = _mm256_srai_epi32(y, 8);
+		// Lanes off the edge of a map that doesn't wrap come out transparent
+		__m256i inside = _mm256_set1_epi32(-1);
+		if (!layout.wrap)
+		{
+			inside = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_andnot_si256(sizeMask, textureX), _mm256_setzero_si256()),
+				_mm256_cmpeq_epi32(_mm256_andnot_si256(sizeMask, textureY), _mm256_setzero_si256()));
+		}
+		textureX = _mm256_and_si256(textureX, sizeMask);
+		textureY = _mm256_and_si256(textureY, sizeMask);
+
+		__m256i mapAddr = _mm256_add_epi32(mapBase,
+			_mm256_add_epi32(_mm256_sll_epi32(_mm256_srli_epi32(textureY, 3), sizeShift), _mm256_srli_epi32(textureX, 3)));
+		__m256i tile = _mm256_and_si256(_mm256_i32gather_epi32(vram, mapAddr, 1), byteMask);
+		__m256i pixelAddr = _mm256_add_epi32(_mm256_add_epi32(tileBase, _mm256_slli_epi32(tile, 6)),
+			_mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(textureY, _mm256_set1_epi32(0x7)), 3), _mm256_and_si256(textureX, _mm256_set1_epi32(0x7))));
+		__m256i pixels = _mm256_and_si256(_mm256_i32gather_epi32(vram, pixelAddr, 1), _mm256_and_si256(byteMask, inside));
+
+		// Pack the 8 32 bit results down to 16 bits
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(pixels), _mm256_extracti128_si256(pixels, 1));
+		_mm_storeu_si128((__m128i*)(out + i), packed);
+	}
+}
+#endif
+
+/* An affine object is sampled from its own tiles, which start at offset 0 of pixels:
+the decoded tiles for 16 colour objects, or OBJ VRAM for 256 colour ones. Either way a
+tile is 64 bytes, a row of it is 8. Object sizes are all powers of two, so the bounds
+check is a mask. Offsets wrap around the end of OBJ VRAM, like the tile numbers do. */
+struct affineObjectLayout
+{
+	const uint8_t* pixels;
+	uint32_t firstTileOffset;
+	int16_t pa;
+	int16_t pc;
+	int widthShift; // log2 of the object's width in pixels
+	int heightShift;
+	int rowShift; // log2 of the distance between tile rows, in bytes
+	uint32_t offsetMask;
+	uint32_t minOffset; // In bitmap modes, the tiles in the first half of OBJ VRAM aren't shown
+};
+
+static void affineObjectScalar(const affineObjectLayout& layout, int32_t x, int32_t y, uint16_t* out, int width)
+{
+	for (int i = 0; i < width; i++, x += layout.pa, y += layout.pc)
+	{
+		int32_t textureX = x >> 8;
+		int32_t textureY = y >> 8;
+		if ((textureX >> layout.widthShift) != 0 || (textureY >> layout.heightShift) != 0)
+		{
+			out[i] = 0;
+			continue;
+		}
+		uint32_t offset = (layout.firstTileOffset + ((textureY >> 3) << layout.rowShift) + ((textureX >> 3) * 64)
+			+ ((textureY & 0x7) * 8) + (textureX & 0x7)) & layout.offsetMask;
+		out[i] = (offset >= layout.minOffset) ? layout.pixels[offset] : 0;
+	}
+}
+
+#ifdef QGBA_X86
+// The same as affineAVX2, but with one gather per pixel since there's no map.
+// A gather at the end of OBJ VRAM reads into the arena's padding, or into the padding after the tile cache's tiles.
+QGBA_TARGET_AVX2 static void affineObjectAVX2(const affineObjectLayout& layout, int32_t x, int32_t y, uint16_t* out, int width)
+{
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i stepX = _mm256_set1_epi32(layout.pa * 8);
+	const __m256i stepY = _mm256_set1_epi32(layout.pc * 8);
+	const __m256i outsideX = _mm256_set1_epi32(~((1 << layout.widthShift) - 1));
+	const __m256i outsideY = _mm256_set1_epi32(~((1 << layout.heightShift) - 1));
+	const __m256i firstTileOffset = _mm256_set1_epi32(layout.firstTileOffset);
+	const __m256i offsetMask = _mm256_set1_epi32(layout.offsetMask);
+	const __m256i belowMin = _mm256_set1_epi32(layout.minOffset);
+	const __m256i byteMask = _mm256_set1_epi32(0xFF);
+	const __m256i seven = _mm256_set1_epi32(0x7);
+	const __m128i rowShift = _mm_cvtsi32_si128(layout.rowShift);
+	__m256i vx = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(layout.pa)));
+	__m256i vy = _mm256_add_epi32(_mm256_set1_epi32(y), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(layout.pc)));
+	const int* pixels = (const int*)layout.pixels;
+
+	for (int i = 0; i < width; i += 8, vx = _mm256_add_epi32(vx, stepX), vy = _mm256_add_epi32(vy, stepY))
+	{
+		__m256i textureX = _mm256_srai_epi32(vx, 8);
+		__m256i textureY = _mm256_srai_epi32(vy, 8);
+		__m256i inside = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(textureX, outsideX), _mm256_setzero_si256()),
+			_mm256_cmpeq_epi32(_mm256_and_si256(textureY, outsideY), _mm256_setzero_si256()));
+
+		__m256i offset = _mm256_add_epi32(_mm256_add_epi32(firstTileOffset, _mm256_sll_epi32(_mm256_srli_epi32(textureY, 3), rowShift)),
+			_mm256_add_epi32(_mm256_slli_epi32(_mm256_srli_epi32(textureX, 3), 6),
+			_mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(textureY, seven), 3), _mm256_and_si256(textureX, seven))));
+		offset = _mm256_and_si256(offset, offsetMask);
+		inside = _mm256_andnot_si256(_mm256_cmpgt_epi32(belowMin, offset), inside);
+		__m256i sampled = _mm256_and_si256(_mm256_i32gather_epi32(pixels, offset, 1), _mm256_and_si256(byteMask, inside));
+
+		__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(sampled), _mm256_extracti128_si256(sampled, 1));
+		_mm_storeu_si128((__m128i*)(out + i), packed);
+	}
+}
+#endif
+
+renderer::renderer(paletteCache* Palette, const uint8_t* vram, tileCache* Tiles, objectList* Objects)
+{
+	this->Palette = Palette;
+	this->vram = vram;
+	this->Tiles = Tiles;
+	this->Objects = Objects;
+	memset(layerLines, 0, sizeof(layerLines));
+	memset(objLine, 0, sizeof(objLine));
+	memset(objSpan, 0, sizeof(objSpan));
+	memset(objPriority, 0, sizeof(objPriority));
+	memset(objSemiTransparent, 0, sizeof(objSemiTransparent));
+	objSemiTransparentUsed = false;
+	memset(objWindow, 0, sizeof(objWindow));
+	objMosaic = false;
+	objMosaicUsed = false;
+	memset(objMosaicLine, 0, sizeof(objMosaicLine));
+	memset(objMosaicFlags, 0, sizeof(objMosaicFlags));
+	memset(objLayers, 0, sizeof(objLayers));
+	objPrioritiesUsed = 0;
+	memset(mergedLine, 0, sizeof(mergedLine));
+	memset(windowMask, 0, sizeof(windowMask));
+	memset(&targets, 0, sizeof(targets));
+	for (int bg = 0; bg < 4; bg++)
+	{
+		layerActive[bg] = false;
+	}
+	tileStats.hits = 0;
+	tileStats.misses = 0;
+	rendererKernels kernels = getKernels(cpuFeatures::getBestLevel());
+	merge = kernels.merge;
+	mergeTargets = kernels.mergeTargets;
+	blend = kernels.blend;
+	mosaic = kernels.mosaic;
+	affine = kernels.affine;
+	affineObject = kernels.affineObject;
+}
+
+// Functions without a version for the level use the one for the level below.
+// The caller has to check that the CPU supports the level.
+rendererKernels renderer::getKernels(simdLevel level)
+{
+	rendererKernels kernels;
+	kernels.merge = mergeScalar;
+	kernels.mergeTargets = mergeTargetsScalar;
+	kernels.blend = blendScalar;
+	kernels.mosaic = mosaicScalar;
+	kernels.affine = affineScalar;
+	kernels.affineObject = affineObjectScalar;
+#ifdef QGBA_X86
+	if (level == simdLevel::AVX2)
+	{
+		kernels.merge = mergeAVX2;
+		kernels.mergeTargets = mergeTargetsAVX2;
+		kernels.blend = blendAVX2;
+		kernels.mosaic = mosaicSSE2;
+		kernels.affine = affineAVX2;
+		kernels.affineObject = affineObjectAVX2;
+	}
+	else if (level == simdLevel::SSE2)
+	{
+		kernels.merge = mergeSSE2;
+		kernels.mergeTargets = mergeTargetsSSE2;
+		kernels.blend = blendSSE2;
+		kernels.mosaic = mosaicSSE2;
+	}
+#endif
+	return kernels;
+}
+
+// mosaicState and mosaicLine are the snapshot and number of the first line in this line's BG mosaic block
+void renderer::drawLine(const renderState& state, int line, const renderState& mosaicState, int mosaicLine, uint32_t* output)
+{
+	const renderState* bgStates[4];
+	int bgLines[4];
+	for (int bg = 0; bg < 4; bg++)
+	{
+		layerActive[bg] = false;
+		bool mosaic = state.BGControl[bg].mosaic;
+		bgStates[bg] = mosaic ? &mosaicState : &state;
+		bgLines[bg] = mosaic ? mosaicLine : line;
+	}
+	switch (state.videoMode)
+	{
+		case 0:
+			for (int bg = 0; bg < 4; bg++)
+			{
+				if (state.enableBG[bg])
+				{
+					drawTextBG(*bgStates[bg], bg, bgLines[bg]);
+				}
+			}
+			break;
+		case 1:
+			for (int bg = 0; bg < 2; bg++)
+			{
+				if (state.enableBG[bg])
+				{
+					drawTextBG(*bgStates[bg], bg, bgLines[bg]);
+				}
+			}
+			if (state.enableBG[2])
+			{
+				drawAffineBG(*bgStates[2], 2);
+			}
+			break;
+		case 2:
+			for (int bg = 2; bg < 4; bg++)
+			{
+				if (state.enableBG[bg])
+				{
+					drawAffineBG(*bgStates[bg], bg);
+				}
+			}
+			break;
+		case 3: case 4: case 5:
+			if (state.enableBG[2])
+			{
+				drawBitmapBG(*bgStates[2], bgLines[2]);
+			}
+			break;
+	}
+	if (state.bgMosaicWidth > 1)
+	{
+		for (int bg = 0; bg < 4; bg++)
+		{
+			if (layerActive[bg] && state.BGControl[bg].mosaic)
+			{
+				mosaic(layerLines[bg] + linePadding, state.bgMosaicWidth, lineWidth);
+			}
+		}
+	}
+	objPrioritiesUsed = 0;
+	objSemiTransparentUsed = false;
+	if (state.enableOBJ)
+	{
+		drawObjects(state, line);
+	}
+	mergeLayers(state, line);
+	outputLine(output);
+}
+
+void renderer::drawTextBG(const renderState& state, int bg, int line)
+{
+	const bgControl& control = state.BGControl[bg];
+	layerActive[bg] = true;
+
+	int y = (line + state.BGYOffset[bg]) & 0x1FF;
+	uint32_t mapBaseAddr = (uint32_t)control.screenBaseBlock << 11;
+	if ((y & 0x100) && (control.screenSize & 0x2))
+	{
+		// The lower screenblocks: 1 in a 256x512 map, 2 and 3 in a 512x512 map
+		mapBaseAddr += (control.screenSize == 0x3) ? 2048 * 2 : 2048;
+	}
+	uint32_t mapRowAddr = mapBaseAddr + ((y & 0xFF) / 8) * 32 * 2;
+	uint32_t tileBaseAddr = (uint32_t)control.charBaseBlock << 14;
+	int tileRow = y % 8;
+
+	// The first tile can start up to 7 pixels left of the screen, which lands in the padding
+	int mapX = state.BGXOffset[bg] & ~0x7;
+	uint16_t* out = layerLines[bg] + linePadding - (state.BGXOffset[bg] & 0x7);
+	for (int tile = 0; tile <= lineWidth / 8; tile++, mapX += 8, out += 8)
+	{
+		mapX &= 0x1FF;
+		uint32_t mapEntryAddr = mapRowAddr + ((mapX & 0xFF) / 8) * 2;
+		if ((mapX & 0x100) && (control.screenSize & 0x1))
+		{
+			mapEntryAddr += 2048; // The right hand screenblock
+		}
+		uint16_t mapEntry = vram[mapEntryAddr] | ((uint16_t)vram[mapEntryAddr + 1] << 8);
+		int row = (mapEntry & 0x800) ? 7 - tileRow : tileRow;
+
+		uint64_t pixels;
+		uint16_t paletteBase;
+		if (control.colourDepth) // 256 colours, 1 palette.
+		{
+			uint32_t rowAddr = tileBaseAddr + ((mapEntry & 0x3FF) * 64) + (row * 8);
+			if (rowAddr >= bgVRAMSize)
+			{
+				memset(out, 0, 8 * sizeof(uint16_t));
+				continue;
+			}
+			memcpy(&pixels, vram + rowAddr, sizeof(pixels));
+			paletteBase = 0;
+		}
+		else // 16 colours, 16 palettes.
+		{
+			uint32_t tileAddr = tileBaseAddr + ((mapEntry & 0x3FF) * 32);
+			if (tileAddr >= bgVRAMSize)
+			{
+				memset(out, 0, 8 * sizeof(uint16_t));
+				continue;
+			}
+			pixels = Tiles->getRow(tileAddr, row, tileStats);
+			paletteBase = (mapEntry >> 12) * 16;
+		}
+		if (mapEntry & 0x400) // Horizontal flip
+		{
+			pixels = tileCache::flipRow(pixels);
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			uint16_t colourIndex = (pixels >> (i * 8)) & 0xFF;
+			out[i] = colourIndex ? paletteBase | colourIndex : 0; // Colour 0 is transparent in every palette
+		}
+	}
+}
+
+void renderer::drawAffineBG(const renderState& state, int bg)
+{
+	const bgControl& control = state.BGControl[bg];
+	layerActive[bg] = true;
+	affineLayout layout;
+	layout.vram = vram;
+	layout.mapBaseAddr = (uint32_t)control.screenBaseBlock << 11;
+	layout.tileBaseAddr = (uint32_t)control.charBaseBlock << 14;
+	layout.sizeShift = 7 + control.screenSize; // 128, 256, 512 or 1024 pixels
+	layout.wrap = control.displayOverflow;
+	affine(layout, state.BGAffine[bg - 2], layerLines[bg] + linePadding, lineWidth);
+}
+
+void renderer::drawBitmapBG(const renderState& state, int line)
+{
+	uint16_t* out = layerLines[2] + linePadding;
+	layerActive[2] = true;
+	switch (state.videoMode)
+	{
+		case 3: // 240x160, 32768 colours
+			for (int x = 0; x < lineWidth; x++)
+			{
+				int addr = (line * lineWidth * 2) + (x * 2);
+				out[x] = directColour | vram[addr] | ((uint16_t)(vram[addr + 1] & 0x7F) << 8);
+			}
+			break;
+		case 4: // 240x160, 256 colours, 2 frames
+		{
+			const uint8_t* frame = vram + (line * lineWidth) + (state.bitmapFrame ? 0xA000 : 0);
+			for (int x = 0; x < lineWidth; x++)
+			{
+				out[x] = frame[x];
+			}
+			break;
+		}
+		case 5: // 160x128, 32768 colours, 2 frames
+		{
+			memset(out, 0, lineWidth * sizeof(uint16_t));
+			if (line >= 128)
+			{
+				break;
+			}
+			const uint8_t* frame = vram + (line * 160 * 2) + (state.bitmapFrame ? 0xA000 : 0);
+			for (int x = 0; x < 160; x++)
+			{
+				out[x] = directColour | frame[x * 2] | ((uint16_t)(frame[(x * 2) + 1] & 0x7F) << 8);
+			}
+			break;
+		}
+	}
+}
+
+/* Only the objects on this line's list are looked at. They're drawn lowest OAM index first,
+and a later object only replaces an OBJ pixel if its priority is higher (a lower number).
+Then the OBJ line is split up by priority. */
+void renderer::drawObjects(const renderState& state, int line)
+{
+	// The OBJ window has to be cleared even without any objects, or the last line's would be used
+	if (state.enableOBJWindow)
+	{
+		memset(objWindow, 0, sizeof(objWindow));
+	}
+	int count = Objects->getLineObjectCount(line);
+	if (count == 0)
+	{
+		return;
+	}
+	memset(objLine, 0, sizeof(objLine));
+	objMosaic = state.objMosaicWidth > 1;
+	objMosaicUsed = false;
+	const uint8_t* indices = Objects->getLineObjects(line);
+	bool tilesDecoded = false;
+	for (int i = 0; i < count; i++)
+	{
+		const objectAttributes& object = Objects->getObject(indices[i]);
+		if (object.mode == 2 && !state.enableOBJWindow)
+		{
+			continue;
+		}
+		// Vertical mosaic draws the row from the first line of the block, or the object's top row
+		// if the block started above it
+		int objectLine = line;
+		if (object.mosaic && state.objMosaicHeight > 1)
+		{
+			objectLine = line - (line % state.objMosaicHeight);
+			int boundsHeight = object.doubleSize ? object.height * 2 : object.height;
+			if (((objectLine - object.y) & 0xFF) >= boundsHeight)
+			{
+				objectLine = object.y;
+			}
+		}
+		if (object.affine)
+		{
+			if (!object.colourDepth && !tilesDecoded)
+			{
+				Tiles->decodeDirty();
+				tilesDecoded = true;
+			}
+			drawAffineObject(state, object, objectLine);
+		}
+		else
+		{
+			drawObject(state, object, objectLine);
+		}
+	}
+	if (objMosaicUsed)
+	{
+		mergeMosaicObjects(state.objMosaicWidth);
+	}
+
+	for (int priority = 0; priority < 4; priority++)
+	{
+		uint16_t* layer = objLayers[priority];
+		uint16_t used = 0;
+		for (int x = 0; x < lineWidth; x++)
+		{
+			layer[x] = (objPriority[x] == priority) ? objLine[x] : 0;
+			used |= layer[x];
+		}
+		if (used)
+		{
+			objPrioritiesUsed |= 1 << priority;
+		}
+	}
+}
+
+void renderer::drawObject(const renderState& state, const objectAttributes& object, int line)
+{
+	int row = (line - object.y) & 0xFF;
+	if (object.vFlip)
+	{
+		row = object.height - 1 - row;
+	}
+	// Tile numbers are always in 32 byte units, so an 8bpp tile takes up two of them
+	int tileSize = object.colourDepth ? 2 : 1;
+	int widthTiles = object.width / 8;
+	// In 2D mapping OBJ VRAM is a 32x32 grid of tiles, in 1D each object's tiles follow each other
+	int rowStride = state.objMapping1D ? widthTiles * tileSize : 32;
+	int firstTile = object.tile + ((row / 8) * rowStride);
+	int pixelRow = row % 8;
+	uint16_t paletteBase = object.colourDepth ? objPaletteBase : objPaletteBase + (object.palette * 16);
+	bool bitmapMode = state.videoMode >= 3;
+
+	for (int column = 0; column < widthTiles; column++)
+	{
+		int screenX = object.x + (column * 8);
+		if (screenX <= -8 || screenX >= lineWidth)
+		{
+			continue;
+		}
+		int sourceColumn = object.hFlip ? widthTiles - 1 - column : column;
+		uint32_t tile = (firstTile + (sourceColumn * tileSize)) & 0x3FF;
+		if (bitmapMode && tile < 512)
+		{
+			continue; // In bitmap modes the first half of OBJ VRAM holds the bitmap
+		}
+
+		uint64_t pixels;
+		if (object.colourDepth)
+		{
+			memcpy(&pixels, vram + objVRAMBase + (((tile * 32) + (pixelRow * 8)) & 0x7FFF), sizeof(pixels));
+		}
+		else
+		{
+			pixels = Tiles->getRow(objVRAMBase + (tile * 32), pixelRow, tileStats);
+		}
+		if (object.hFlip)
+		{
+			pixels = tileCache::flipRow(pixels);
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			int x = screenX + i;
+			uint16_t colourIndex = (pixels >> (i * 8)) & 0xFF;
+			if (colourIndex != 0 && x >= 0 && x < lineWidth)
+			{
+				drawObjectPixel(object, x, paletteBase | colourIndex);
+			}
+		}
+	}
+}
+
+/* The matrix maps screen space to texture space around the centre of the object, and
+the double size flag makes the area it's drawn in twice as wide and high without
+scaling it. The line's leftmost visible pixel gets its texture coordinate from the matrix,
+and the rest are stepped by (pa, pc) in the sampler. */
+void renderer::drawAffineObject(const renderState& state, const objectAttributes& object, int line)
+{
+	const objectAffine& matrix = Objects->getAffineGroup(object.affineGroup);
+	int boundsWidth = object.doubleSize ? object.width * 2 : object.width;
+	int boundsHeight = object.doubleSize ? object.height * 2 : object.height;
+	int firstX = object.x < 0 ? -object.x : 0;
+	int lastX = (object.x + boundsWidth > lineWidth) ? lineWidth - object.x : boundsWidth;
+	if (firstX >= lastX)
+	{
+		return;
+	}
+	int centreX = boundsWidth / 2;
+	int centreY = boundsHeight / 2;
+	int row = ((line - object.y) & 0xFF) - centreY;
+	int column = firstX - centreX;
+
+	affineObjectLayout layout;
+	int tileSize = object.colourDepth ? 2 : 1;
+	int rowStride = state.objMapping1D ? (object.width / 8) * tileSize : 32;
+	if (object.colourDepth)
+	{
+		// Tiles are 32 bytes in tile numbers, and an 8bpp tile takes two of them
+		layout.pixels = vram + objVRAMBase;
+		layout.firstTileOffset = object.tile * 32;
+		layout.rowShift = cpuFeatures::countTrailingZeros(rowStride * 32);
+		layout.offsetMask = 0x7FFF;
+		layout.minOffset = (state.videoMode >= 3) ? 512 * 32 : 0;
+	}
+	else
+	{
+		// Each decoded tile is 64 bytes
+		layout.pixels = Tiles->getDecodedTiles() + (objVRAMBase / 32) * 64;
+		layout.firstTileOffset = object.tile * 64;
+		layout.rowShift = cpuFeatures::countTrailingZeros(rowStride * 64);
+		layout.offsetMask = 0xFFFF;
+		layout.minOffset = (state.videoMode >= 3) ? 512 * 64 : 0;
+	}
+	layout.pa = matrix.pa;
+	layout.pc = matrix.pc;
+	layout.widthShift = cpuFeatures::countTrailingZeros(object.width);
+	layout.heightShift = cpuFeatures::countTrailingZeros(object.height);
+	int32_t x = (matrix.pa * column) + (matrix.pb * row) + ((object.width / 2) << 8);
+	int32_t y = (matrix.pc * column) + (matrix.pd * row) + ((object.height / 2) << 8);
+	int width = lastX - firstX;
+	affineObject(layout, x, y, objSpan, width);
+
+	uint16_t paletteBase = object.colourDepth ? objPaletteBase : objPaletteBase + (object.palette * 16);
+	int screenX = object.x + firstX;
+	for (int i = 0; i < width; i++, screenX++)
+	{
+		uint16_t colourIndex = objSpan[i];
+		if (colourIndex != 0)
+		{
+			drawObjectPixel(object, screenX, paletteBase | colourIndex);
+		}
+	}
+}
+
+// OBJ window objects aren't drawn, they just mark where the OBJ window is
+void renderer::drawObjectPixel(const objectAttributes& object, int x, uint16_t entry)
+{
+	if (object.mode == 2)
+	{
+		objWindow[x] = true;
+	}
+	else if (object.mosaic && objMosaic)
+	{
+		if (!objMosaicUsed)
+		{
+			memset(objMosaicLine, 0, sizeof(objMosaicLine));
+			objMosaicUsed = true;
+		}
+		if (objMosaicLine[x] == 0 || object.priority < (objMosaicFlags[x] & 0x3))
+		{
+			objMosaicLine[x] = entry;
+			objMosaicFlags[x] = object.priority | ((object.mode == 1) ? 0x4 : 0);
+		}
+	}
+	else if (objLine[x] == 0 || object.priority < objPriority[x])
+	{
+		objLine[x] = entry;
+		objPriority[x] = object.priority;
+		objSemiTransparent[x] = object.mode == 1;
+		objSemiTransparentUsed |= object.mode == 1;
+	}
+}
+
+// Repeats the mosaic OBJ pixels across their blocks, then puts them under the other OBJ pixels,
+// unless they have a higher priority
+void renderer::mergeMosaicObjects(int size)
+{
+	mosaic(objMosaicLine, size, lineWidth);
+	mosaic(objMosaicFlags, size, lineWidth);
+	for (int x = 0; x < lineWidth; x++)
+	{
+		uint16_t entry = objMosaicLine[x];
+		int priority = objMosaicFlags[x] & 0x3;
+		if (entry != 0 && (objLine[x] == 0 || priority < objPriority[x]))
+		{
+			objLine[x] = entry;
+			objPriority[x] = priority;
+			objSemiTransparent[x] = objMosaicFlags[x] & 0x4;
+			objSemiTransparentUsed |= objSemiTransparent[x];
+		}
+	}
+}
+
+/* Window 0 has priority over window 1, which has priority over the OBJ window.
+Pixels outside all of the enabled windows use WINOUT.
+X2 and Y2 are the first pixel past the window. If X1 > X2 or X2 > 240,
+X2 is treated as 240, and the same goes for Y2 and 160. */
+void renderer::buildWindowMask(const renderState& state, int line)
+{
+	for (int x = 0; x < lineWidth; x++)
+	{
+		windowMask[x] = state.windowOutside;
+	}
+	if (state.enableOBJWindow && state.enableOBJ)
+	{
+		for (int x = 0; x < lineWidth; x++)
+		{
+			windowMask[x] = objWindow[x] ? state.objWindowInside : windowMask[x];
+		}
+	}
+	for (int window = 1; window >= 0; window--)
+	{
+		if (!state.enableWindow[window])
+		{
+			continue;
+		}
+		int top = state.windowTop[window];
+		int bottom = state.windowBottom[window];
+		if (bottom > 160 || top > bottom)
+		{
+			bottom = 160;
+		}
+		if (line < top || line >= bottom)
+		{
+			continue;
+		}
+		int left = state.windowLeft[window];
+		int right = state.windowRight[window];
+		if (right > lineWidth || left > right)
+		{
+			right = lineWidth;
+		}
+		for (int x = left; x < right; x++)
+		{
+			windowMask[x] = state.windowInside[window];
+		}
+	}
+}
+
+// The layer order only depends on the BG priorities, so it's worked out once per line.
+// Lower priority numbers are in front. BGs with the same priority are ordered by number,
+// and OBJ pixels go in front of BGs with the same priority.
+// Lines without windows or colour effects only need the plain merge.
+void renderer::mergeLayers(const renderState& state, int line)
+{
+	const uint16_t* layers[8];
+	uint16_t layerBits[8];
+	int layerCount = 0;
+	for (int priority = 3; priority >= 0; priority--)
+	{
+		for (int bg = 3; bg >= 0; bg--)
+		{
+			if (layerActive[bg] && state.BGControl[bg].priority == priority)
+			{
+				layerBits[layerCount] = 1 << bg;
+				layers[layerCount++] = layerLines[bg] + linePadding;
+			}
+		}
+		if (objPrioritiesUsed & (1 << priority))
+		{
+			layerBits[layerCount] = objLayerBit;
+			layers[layerCount++] = objLayers[priority];
+		}
+	}
+
+	bool windows = state.enableWindow[0] || state.enableWindow[1] || state.enableOBJWindow;
+	bool effects = (state.blendEffect != 0 && state.blendFirstTargets != 0) || objSemiTransparentUsed;
+	if (!windows && !effects)
+	{
+		merge(layers, layerCount, mergedLine, lineWidth);
+		return;
+	}
+	if (windows)
+	{
+		buildWindowMask(state, line);
+	}
+	else
+	{
+		for (int x = 0; x < lineWidth; x++)
+		{
+			windowMask[x] = 0x3F;
+		}
+	}
+	mergeTargets(layers, layerBits, layerCount, windowMask, targets, lineWidth);
+	if (effects)
+	{
+		blendLayers(state);
+	}
+	else
+	{
+		memcpy(mergedLine, targets.top, sizeof(mergedLine));
+	}
+}
+
+// Turns the top two pixels into BGR555 colours, and clears the top layer's bits
+// where the window turns effects off so that nothing is blended there.
+void renderer::blendLayers(const renderState& state)
+{
+	const uint16_t* colours = Palette->getBGRColours();
+	for (int x = 0; x < lineWidth; x++)
+	{
+		uint16_t top = targets.top[x];
+		uint16_t second = targets.second[x];
+		targets.top[x] = (top & directColour) ? top & 0x7FFF : colours[top];
+		targets.second[x] = (second & directColour) ? second & 0x7FFF : colours[second];
+		if (!(windowMask[x] & effectsBit))
+		{
+			targets.topLayer[x] = 0;
+		}
+		else if (targets.topLayer[x] == objLayerBit && objSemiTransparent[x])
+		{
+			targets.topLayer[x] |= semiTransparentBit;
+		}
+	}
+
+	blendSettings settings;
+	settings.firstTargets = state.blendFirstTargets;
+	settings.secondTargets = state.blendSecondTargets;
+	settings.alpha = state.blendEffect == 1;
+	settings.brightness = state.blendEffect >= 2;
+	settings.brighten = state.blendEffect == 2;
+	settings.firstWeight = state.blendFirstWeight > 16 ? 16 : state.blendFirstWeight;
+	settings.secondWeight = state.blendSecondWeight > 16 ? 16 : state.blendSecondWeight;
+	settings.brightnessWeight = state.brightness > 16 ? 16 : state.brightness;
+	blend(targets, settings, mergedLine, lineWidth);
+}
+
+// Each pixel is one table load, from the palette cache or the direct colour table
+void renderer::outputLine(uint32_t* output)
+{
+	const uint32_t* colours = Palette->getColours();
+	const uint32_t* directColours = Palette->getDirectColours();
+	for (int x = 0; x < lineWidth; x++)
+	{
+		uint16_t entry = mergedLine[x];
+		output[x] = (entry & directColour) ? directColours[entry & 0x7FFF] : colours[entry];
+	}
+}
+
+void bgControl::setLow(uint8_t value)
+{
+	priority = value & 0x3;
+	charBaseBlock = (value >> 2) & 0x3;
+	mosaic = value & 0x40;
+	colourDepth = value & 0x80;
+}
+
+void bgControl::setHigh(uint8_t value)
+{
+	screenBaseBlock = value & 0x1F;
+	displayOverflow = value & 0x20;
+	screenSize = (value >> 6) & 0x3;
+}
+
+uint8_t bgControl::getLow()
+{
+	uint8_t ret = priority
+		| (charBaseBlock << 2)
+		| ((uint8_t)mosaic << 6)
+		| ((uint8_t)colourDepth << 7);
+	return ret;
+}
+
+uint8_t bgControl::getHigh()
+{
+	uint8_t ret = screenBaseBlock
+		| ((uint8_t)displayOverflow << 5)
+		| (screenSize << 6);
+	return ret;
+}
+
+void bgControl::set(uint16_t value)
+{
+	setLow(value & 0xFF);
+	setHigh(value >> 8);
+}
+
+uint16_t bgControl::get()
+{
+	return getLow() | ((uint16_t)getHigh() << 8);
+}
\ No newline at end of file
@@ -0,0 +1,185 @@
+#pragma once
+#include <cstdint>
+#include "tilecache.hpp"
+#include "palette.hpp"
+#include "objects.hpp"
+#include "simd.hpp"
+
+struct bgControl
+{
+	uint8_t priority;
+	uint8_t charBaseBlock;
+	bool mosaic;
+	bool colourDepth; // 0 = 16 colours, 16 palettes. 1 = 256 colours, 1 palette.
+	uint8_t screenBaseBlock;
+	bool displayOverflow;
+	uint8_t screenSize;
+
+	void setLow(uint8_t value);
+	void setHigh(uint8_t value);
+	uint8_t getLow();
+	uint8_t getHigh();
+	void set(uint16_t value);
+	uint16_t get();
+};
+
+// The rotation/scaling parameters of BG2 or BG3. The 8.8 fixed point matrix is applied per pixel,
+// and x and y are the 20.8 fixed point texture coordinates of the line's leftmost pixel.
+struct affineParams
+{
+	int16_t pa; // dx, added to x for each pixel
+	int16_t pb; // dmx, added to x for each line
+	int16_t pc; // dy, added to y for each pixel
+	int16_t pd; // dmy, added to y for each line
+	int32_t x;
+	int32_t y;
+};
+
+// The display registers that decide how a scanline is drawn.
+struct renderState
+{
+	uint8_t videoMode;
+	bool bitmapFrame;
+	bool objMapping1D; // 0 = Two dimensional, 1 = One dimensional
+	bool enableBG[4];
+	bool enableOBJ;
+	bgControl BGControl[4];
+	uint16_t BGXOffset[4];
+	uint16_t BGYOffset[4];
+	affineParams BGAffine[2]; // BG2 and BG3
+	bool enableWindow[2]; // WIN0 and WIN1
+	bool enableOBJWindow;
+	uint8_t windowLeft[2]; // X1, the leftmost pixel inside
+	uint8_t windowRight[2]; // X2, the first pixel right of the window
+	uint8_t windowTop[2];
+	uint8_t windowBottom[2];
+	// Which layers show in each area. Bits 0-3 are BG0-BG3, bit 4 is OBJ and bit 5 enables colour effects.
+	uint8_t windowInside[2];
+	uint8_t windowOutside;
+	uint8_t objWindowInside;
+	// The layers colour effects apply to. Bits 0-4 are the same as the windows', bit 5 is the backdrop.
+	uint8_t blendFirstTargets;
+	uint8_t blendSecondTargets;
+	uint8_t blendEffect; // 0 = None, 1 = Alpha blending, 2 = Brightness increase, 3 = Brightness decrease
+	uint8_t blendFirstWeight; // EVA, 0-31. 16 and up are treated as 16.
+	uint8_t blendSecondWeight; // EVB
+	uint8_t brightness; // EVY
+	// MOSAIC, as block sizes from 1 to 16 pixels
+	uint8_t bgMosaicWidth;
+	uint8_t bgMosaicHeight;
+	uint8_t objMosaicWidth;
+	uint8_t objMosaicHeight;
+};
+
+// The two frontmost visible pixels on a line, and which layer each came from as a BLDCNT target bit.
+// top and second start out as line buffer entries, and are turned into BGR555 colours before blending.
+struct layerTargets
+{
+	uint16_t top[240];
+	uint16_t second[240];
+	uint16_t topLayer[240];
+	uint16_t secondLayer[240];
+};
+
+struct blendSettings
+{
+	uint16_t firstTargets;
+	uint16_t secondTargets;
+	bool alpha; // Whether BLDCNT selects alpha blending
+	bool brightness; // Whether BLDCNT selects a brightness change
+	bool brighten; // Increase rather than decrease
+	uint16_t firstWeight;
+	uint16_t secondWeight;
+	uint16_t brightnessWeight;
+};
+
+// Paints layers[0] to layers[layerCount - 1] over each other, back to front
+typedef void (*mergeFunction)(const uint16_t* const* layers, int layerCount, uint16_t* out, int width);
+// The same, but a layer only shows where its bit is set in windowMask, and the two frontmost pixels are kept
+typedef void (*mergeTargetsFunction)(const uint16_t* const* layers, const uint16_t* layerBits, int layerCount, const uint16_t* windowMask, layerTargets& targets, int width);
+// Applies the colour effects to a line of layerTargets, giving direct colour entries
+typedef void (*blendFunction)(const layerTargets& targets, const blendSettings& settings, uint16_t* out, int width);
+// Repeats the first pixel of each size pixel block across the block. line needs 7 spare entries after width.
+typedef void (*mosaicFunction)(uint16_t* line, int size, int width);
+struct affineLayout;
+// Draws one line of an affine BG
+typedef void (*affineFunction)(const affineLayout& layout, const affineParams& params, uint16_t* out, int width);
+struct affineObjectLayout;
+// Samples one line of an affine OBJ, starting at texture coordinate (x, y)
+typedef void (*affineObjectFunction)(const affineObjectLayout& layout, int32_t x, int32_t y, uint16_t* out, int width);
+
+// The line functions built for one instruction set
+struct rendererKernels
+{
+	mergeFunction merge;
+	mergeTargetsFunction mergeTargets;
+	blendFunction blend;
+	mosaicFunction mosaic;
+	affineFunction affine;
+	affineObjectFunction affineObject;
+};
+
+/* Draws scanlines from a renderState and the video memory.
+Each layer is first drawn into its own line buffer, then the layers are merged.
+A line buffer entry is 0 for a transparent pixel, a palette index for
+paletted pixels (256 and up for OBJ), or a BGR555 colour with bit 15 set for direct colour pixels.
+OBJ pixels are split into one layer per priority so they can be merged like BGs.
+When windows or colour effects are on, the merge also masks each layer with the line's
+window mask and keeps the two frontmost pixels, which are then blended as BGR555 colours.
+Mosaic BGs are drawn from the snapshot of the first line in their mosaic block,
+then horizontal mosaic is applied to the finished layer line. Mosaic OBJs get their
+own line for that, which is then merged with the other OBJ pixels. */
+class renderer
+{
+	private:
+		static constexpr int lineWidth = 240;
+		static constexpr int linePadding = 8; // Lets tile spans run past either edge of the screen
+		static constexpr uint16_t directColour = 0x8000;
+
+		paletteCache* Palette;
+		const uint8_t* vram;
+		tileCache* Tiles;
+		objectList* Objects;
+		uint16_t layerLines[4][linePadding + lineWidth + linePadding];
+		bool layerActive[4]; // Whether each BG was drawn on this line
+		uint16_t objLine[lineWidth];
+		uint16_t objSpan[lineWidth + 8]; // An affine object's pixels, before they're put in objLine
+		uint8_t objPriority[lineWidth];
+		bool objSemiTransparent[lineWidth];
+		bool objSemiTransparentUsed;
+		bool objWindow[lineWidth]; // Whether an OBJ window object covers each pixel
+		bool objMosaic; // Whether mosaic OBJs go in objMosaicLine
+		bool objMosaicUsed;
+		uint16_t objMosaicLine[lineWidth + 8];
+		uint16_t objMosaicFlags[lineWidth + 8]; // Priority in bits 0-1, semi-transparency in bit 2
+		uint16_t objLayers[4][lineWidth];
+		uint8_t objPrioritiesUsed; // Bit n is set if objLayers[n] has anything in it
+		uint16_t mergedLine[lineWidth];
+		uint16_t windowMask[lineWidth]; // The layers shown at each pixel, bits as in windowInside
+		layerTargets targets;
+		mergeFunction merge; // The fastest versions this CPU supports
+		mergeTargetsFunction mergeTargets;
+		blendFunction blend;
+		mosaicFunction mosaic;
+		affineFunction affine;
+		affineObjectFunction affineObject;
+		tileCacheStats tileStats;
+
+		void drawTextBG(const renderState& state, int bg, int line);
+		void drawAffineBG(const renderState& state, int bg);
+		void drawBitmapBG(const renderState& state, int line);
+		void drawObjects(const renderState& state, int line);
+		void mergeMosaicObjects(int size);
+		void drawObject(const renderState& state, const objectAttributes& object, int line);
+		void drawAffineObject(const renderState& state, const objectAttributes& object, int line);
+		void drawObjectPixel(const objectAttributes& object, int x, uint16_t entry);
+		void buildWindowMask(const renderState& state, int line);
+		void mergeLayers(const renderState& state, int line);
+		void blendLayers(const renderState& state);
+		void outputLine(uint32_t* output);
+	public:
+		renderer(paletteCache* Palette, const uint8_t* vram, tileCache* Tiles, objectList* Objects);
+		void drawLine(const renderState& state, int line, const renderState& mosaicState, int mosaicLine, uint32_t* output);
+		const tileCacheStats& getTileStats() { return tileStats; }
+		static rendererKernels getKernels(simdLevel level);
+};
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "savefile.hpp"
+#include "logging.hpp"
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Wait this long after the first dirty write before syncing, so a game
+// writing its save one byte at a time only causes one flush.
+constexpr auto flushDelay = std::chrono::milliseconds(200);
+
+saveFile::saveFile(std::string path, size_t size, uint8_t fill)
+{
+	this->size = size;
+	dirtyStart = size;
+	dirtyEnd = 0;
+	stopping = false;
+	mapped = map(path, fill);
+	if (mapped)
+	{
+		logging::info("Mapped save file: " + path, "savefile");
+		flushThread = std::thread(&saveFile::flushLoop, this);
+	}
+	else
+	{
+		logging::error("Couldn't map save file " + path + ", progress won't be saved", "savefile");
+		data = new uint8_t[size];
+		memset(data, fill, size);
+	}
+}
+
+saveFile::~saveFile()
+{
+	if (mapped)
+	{
+		{
+			std::lock_guard<std::mutex> lock(flushMutex);
+			stopping = true;
+		}
+		flushCondition.notify_one();
+		flushThread.join();
+		unmap();
+	}
+	else
+	{
+		delete[] data;
+	}
+}
+
+uint8_t* saveFile::getData()
+{
+	return data;
+}
+
+size_t saveFile::getSize()
+{
+	return size;
+}
+
+// Returns the size of the file at path, or -1 if it doesn't exist.
+long long saveFile::existingSize(std::string path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		return -1;
+	}
+	fseek(file, 0, SEEK_END);
+	long long fileSize = ftell(file);
+	fclose(file);
+	return fileSize;
+}
+
+void saveFile::markDirty(size_t offset, size_t length)
+{
+	if (!mapped)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(flushMutex);
+	bool wasClean = dirtyStart >= dirtyEnd;
+	dirtyStart = std::min(dirtyStart, offset);
+	dirtyEnd = std::max(dirtyEnd, std::min(offset + length, size));
+	if (wasClean)
+	{
+		flushCondition.notify_one();
+	}
+}
+
+void saveFile::flushLoop()
+{
+	std::unique_lock<std::mutex> lock(flushMutex);
+	while (true)
+	{
+		flushCondition.wait(lock, [this] { return stopping || dirtyStart < dirtyEnd; });
+		if (!stopping)
+		{
+			flushCondition.wait_for(lock, flushDelay, [this] { return stopping; });
+		}
+		size_t start = dirtyStart;
+		size_t end = dirtyEnd;
+		dirtyStart = size;
+		dirtyEnd = 0;
+		if (start < end)
+		{
+			// Don't hold the lock while syncing, so the emulator can keep marking writes
+			lock.unlock();
+			flushRange(start, end);
+			lock.lock();
+		}
+		if (stopping && dirtyStart >= dirtyEnd)
+		{
+			return;
+		}
+	}
+}
+
+#ifdef _WIN32
+
+bool saveFile::map(std::string path, uint8_t fill)
+{
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER oldSize;
+	if (!GetFileSizeEx(file, &oldSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	// Mapping more than the file holds grows the file to fit
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, (DWORD)size, NULL);
+	if (mapping == NULL)
+	{
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = (uint8_t*)view;
+	if ((size_t)oldSize.QuadPart < size)
+	{
+		memset(data + oldSize.QuadPart, fill, size - (size_t)oldSize.QuadPart);
+		flushRange((size_t)oldSize.QuadPart, size);
+	}
+	return true;
+}
+
+void saveFile::unmap()
+{
+	FlushViewOfFile(data, size);
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mappingHandle);
+	FlushFileBuffers((HANDLE)fileHandle);
+	CloseHandle((HANDLE)fileHandle);
+}
+
+void saveFile::flushRange(size_t start, size_t end)
+{
+	FlushViewOfFile(data + start, end - start);
+	FlushFileBuffers((HANDLE)fileHandle);
+}
+
+#else
+
+bool saveFile::map(std::string path, uint8_t fill)
+{
+	int file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0)
+	{
+		close(file);
+		return false;
+	}
+	size_t oldSize = info.st_size;
+	if (oldSize < size && ftruncate(file, size) != 0)
+	{
+		close(file);
+		return false;
+	}
+	void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close(file);
+		return false;
+	}
+	fileDescriptor = file;
+	data = (uint8_t*)mapping;
+	if (oldSize < size)
+	{
+		memset(data + oldSize, fill, size - oldSize);
+		flushRange(oldSize, size);
+	}
+	return true;
+}
+
+void saveFile::unmap()
+{
+	msync(data, size, MS_SYNC);
+	munmap(data, size);
+	close(fileDescriptor);
+}
+
+void saveFile::flushRange(size_t start, size_t end)
+{
+	// msync needs a page aligned start address
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedStart = start - (start % pageSize);
+	msync(data + alignedStart, end - alignedStart, MS_SYNC);
+}
+
+#endif
\ No newline at end of file
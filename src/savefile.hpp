@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A save file mapped straight into memory. Writes land in the mapping,
+// and the dirty range is flushed to disk by a background thread so saving
+// never holds up emulation.
+class saveFile
+{
+	private:
+		uint8_t* data;
+		size_t size;
+		bool mapped;
+#ifdef _WIN32
+		void* fileHandle;
+		void* mappingHandle;
+#else
+		int fileDescriptor;
+#endif
+
+		std::thread flushThread;
+		std::mutex flushMutex;
+		std::condition_variable flushCondition;
+		size_t dirtyStart;
+		size_t dirtyEnd;
+		bool stopping;
+
+		bool map(std::string path, uint8_t fill);
+		void unmap();
+		void flushRange(size_t start, size_t end);
+		void flushLoop();
+	public:
+		saveFile(std::string path, size_t size, uint8_t fill);
+		~saveFile();
+		uint8_t* getData();
+		size_t getSize();
+		void markDirty(size_t offset, size_t length);
+		static long long existingSize(std::string path);
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "scheduler.hpp"
+#include "logging.hpp"
+#include <algorithm>
+
+// Orders the heap so the earliest event is at the front
+bool scheduler::laterThan(const scheduledEvent& a, const scheduledEvent& b)
+{
+	if (a.time != b.time)
+	{
+		return a.time > b.time;
+	}
+	return a.order > b.order;
+}
+
+scheduler::scheduler()
+{
+	now = 0;
+	nextTime = UINT64_MAX;
+	scheduleCount = 0;
+	for (int i = 0; i < (int)eventType::Count; i++)
+	{
+		handlers[i].handler = nullptr;
+		handlers[i].owner = nullptr;
+		generation[i] = 0;
+		pending[i] = false;
+		dueTime[i] = 0;
+	}
+}
+
+void scheduler::setHandler(eventType type, eventHandler handler, void* owner)
+{
+	handlers[(int)type].handler = handler;
+	handlers[(int)type].owner = owner;
+}
+
+void scheduler::schedule(eventType type, uint64_t cyclesFromNow)
+{
+	scheduleAt(type, now + cyclesFromNow);
+}
+
+void scheduler::scheduleAt(eventType type, uint64_t time)
+{
+	int index = (int)type;
+	generation[index]++;
+	pending[index] = true;
+	dueTime[index] = time;
+	queue.push_back({ time, scheduleCount++, type, generation[index] });
+	std::push_heap(queue.begin(), queue.end(), laterThan);
+	nextTime = std::min(nextTime, time);
+}
+
+void scheduler::cancel(eventType type)
+{
+	int index = (int)type;
+	if (pending[index])
+	{
+		generation[index]++;
+		pending[index] = false;
+	}
+}
+
+bool scheduler::isScheduled(eventType type)
+{
+	return pending[(int)type];
+}
+
+uint64_t scheduler::getDueTime(eventType type)
+{
+	return dueTime[(int)type];
+}
+
+// Fires every event that is due, including any the handlers schedule for now or earlier.
+void scheduler::runEvents()
+{
+	while (!queue.empty() && queue.front().time <= now)
+	{
+		scheduledEvent event = queue.front();
+		std::pop_heap(queue.begin(), queue.end(), laterThan);
+		queue.pop_back();
+		int index = (int)event.type;
+		if (!pending[index] || event.generation != generation[index])
+		{
+			continue; // Cancelled or rescheduled
+		}
+		pending[index] = false;
+		if (handlers[index].handler != nullptr)
+		{
+			handlers[index].handler(handlers[index].owner, event.time);
+		}
+		else
+		{
+			logging::error("Event " + std::to_string(index) + " has no handler", "scheduler");
+		}
+	}
+	updateNextTime();
+}
+
+void scheduler::updateNextTime()
+{
+	// Drop stale entries from the front so they don't cut the CPU's run short
+	while (!queue.empty())
+	{
+		const scheduledEvent& event = queue.front();
+		int index = (int)event.type;
+		if (pending[index] && event.generation == generation[index])
+		{
+			break;
+		}
+		std::pop_heap(queue.begin(), queue.end(), laterThan);
+		queue.pop_back();
+	}
+	nextTime = queue.empty() ? UINT64_MAX : queue.front().time;
+}
\ No newline at end of file
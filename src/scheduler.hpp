@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+enum class eventType: int
+{
+	DMA0Start = 0,
+	DMA1Start,
+	DMA2Start,
+	DMA3Start,
+	Timer0Overflow,
+	Timer1Overflow,
+	Timer2Overflow,
+	Timer3Overflow,
+	HBlankStart,
+	ScanlineEnd,
+	Count
+};
+
+// Called when an event fires. time is when it was due, which can be a few cycles before now.
+typedef void (*eventHandler)(void* owner, uint64_t time);
+
+/* Keeps the master cycle clock and a min-heap of upcoming events.
+Each event type is either pending once or not at all. Rescheduling or
+cancelling one leaves its old heap entry behind, which gets skipped when popped. */
+class scheduler
+{
+	private:
+		struct scheduledEvent
+		{
+			uint64_t time;
+			uint64_t order; // Events due at the same time run in the order they were scheduled
+			eventType type;
+			uint32_t generation;
+		};
+		struct handlerEntry
+		{
+			eventHandler handler;
+			void* owner;
+		};
+
+		uint64_t now;
+		uint64_t nextTime;
+		uint64_t scheduleCount;
+		std::vector<scheduledEvent> queue;
+		handlerEntry handlers[(int)eventType::Count];
+		uint32_t generation[(int)eventType::Count];
+		bool pending[(int)eventType::Count];
+		uint64_t dueTime[(int)eventType::Count];
+
+		static bool laterThan(const scheduledEvent& a, const scheduledEvent& b);
+		void updateNextTime();
+	public:
+		scheduler();
+		void setHandler(eventType type, eventHandler handler, void* owner);
+		void schedule(eventType type, uint64_t cyclesFromNow);
+		void scheduleAt(eventType type, uint64_t time);
+		void cancel(eventType type);
+		bool isScheduled(eventType type);
+		uint64_t getDueTime(eventType type);
+		void runEvents();
+		uint64_t getNow() { return now; }
+		uint64_t getNextEventTime() { return nextTime; }
+		void addCycles(uint64_t cycles) { now += cycles; }
+};
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <cstdint>
+#include "simd.hpp"
+#if defined(QGBA_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(QGBA_X86)
+#include <cpuid.h>
+#endif
+
+#ifdef QGBA_X86
+static void cpuid(int leaf, int subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, leaf, subleaf);
+	for (int i = 0; i < 4; i++)
+	{
+		regs[i] = (uint32_t)info[i];
+	}
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t readXCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+static bool detectAVX2()
+{
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	if (regs[0] < 7)
+	{
+		return false;
+	}
+	cpuid(1, 0, regs);
+	bool osxsave = regs[2] & (1 << 27);
+	bool avx = regs[2] & (1 << 28);
+	if (!osxsave || !avx)
+	{
+		return false;
+	}
+	// The OS has to save the YMM registers on context switches
+	if ((readXCR0() & 0x6) != 0x6)
+	{
+		return false;
+	}
+	cpuid(7, 0, regs);
+	return regs[1] & (1 << 5);
+}
+#endif
+
+bool cpuFeatures::hasSSE2()
+{
+#ifdef QGBA_X86
+	static const bool sse2 = []()
+	{
+		uint32_t regs[4];
+		cpuid(1, 0, regs);
+		return (regs[3] & (1 << 26)) != 0;
+	}();
+	return sse2;
+#else
+	return false;
+#endif
+}
+
+bool cpuFeatures::hasAVX2()
+{
+#ifdef QGBA_X86
+	static const bool avx2 = detectAVX2();
+	return avx2;
+#else
+	return false;
+#endif
+}
+
+simdLevel cpuFeatures::getBestLevel()
+{
+	if (hasAVX2())
+	{
+		return simdLevel::AVX2;
+	}
+	return hasSSE2() ? simdLevel::SSE2 : simdLevel::Scalar;
+}
+
+int cpuFeatures::countTrailingZeros(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+// x86 SIMD support. Anything vectorised should have a scalar fallback for
+// other platforms, and pick its AVX2 path at runtime with cpuFeatures.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define QGBA_X86 1
+#include <immintrin.h>
+#endif
+
+// GCC and Clang need AVX2 functions marked so they can be built without -mavx2.
+// MSVC lets any function use the intrinsics.
+#if defined(QGBA_X86) && (defined(__GNUC__) || defined(__clang__))
+#define QGBA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define QGBA_TARGET_AVX2
+#endif
+
+enum class simdLevel
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+class cpuFeatures
+{
+	private:
+		cpuFeatures() {}
+	public:
+		static bool hasSSE2();
+		static bool hasAVX2();
+		static simdLevel getBestLevel();
+		static int countTrailingZeros(uint32_t value);
+};
\ No newline at end of file
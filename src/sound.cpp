@@ -0,0 +1,142 @@
+#include "sound.hpp"
+#include "logging.hpp"
+#include "helpers.hpp"
+#include <cstring>
+
+/* 4000082h - SOUNDCNT_H (GBA only) - DMA Sound Control/Mixing (R/W)
+  Bit   Expl.
+  0-1   Sound # 1-4 Volume   (0=25%, 1=50%, 2=100%, 3=Prohibited)
+  2     DMA Sound A Volume   (0=50%, 1=100%)
+  3     DMA Sound B Volume   (0=50%, 1=100%)
+  4-7   Not used
+  8     DMA Sound A Enable RIGHT (0=Disable, 1=Enable)
+  9     DMA Sound A Enable LEFT  (0=Disable, 1=Enable)
+  10    DMA Sound A Timer Select (0=Timer 0, 1=Timer 1)
+  11    DMA Sound A Reset FIFO   (1=Reset)
+  12    DMA Sound B Enable RIGHT (0=Disable, 1=Enable)
+  13    DMA Sound B Enable LEFT  (0=Disable, 1=Enable)
+  14    DMA Sound B Timer Select (0=Timer 0, 1=Timer 1)
+  15    DMA Sound B Reset FIFO   (1=Reset)
+
+Each time the selected timer overflows, one sample is taken from the FIFO.
+Once it's down to 16 bytes, the DMA channel with that FIFO as its destination
+is asked for 4 more words. */
+
+constexpr uint32_t fifoAAddr = 0x40000A0;
+constexpr uint32_t fifoBAddr = 0x40000A4;
+constexpr int fifoRefillLevel = 16;
+
+sound::sound(dma* DMA)
+{
+	this->DMA = DMA;
+	memset(registers, 0, sizeof(registers));
+	registers[0x89 - 0x60] = 0x02; // SOUNDBIAS starts at 0x200
+	masterEnable = false;
+	fifoA.reset();
+	fifoB.reset();
+}
+
+void sound::setRegister(uint32_t addr, uint8_t value)
+{
+	uint32_t offset = addr - 0x4000000;
+	if (offset >= 0xA0 && offset < 0xA4)
+	{
+		fifoA.push(value);
+	}
+	else if (offset >= 0xA4 && offset < 0xA8)
+	{
+		fifoB.push(value);
+	}
+	else if (offset >= 0x60 && offset < 0xA0)
+	{
+		switch (offset)
+		{
+			case 0x83: // SOUNDCNT_H byte 2
+				if (value & 0x08)
+				{
+					fifoA.reset();
+				}
+				if (value & 0x80)
+				{
+					fifoB.reset();
+				}
+				value &= 0x77; // The reset bits read back as 0
+				break;
+			case 0x84: // SOUNDCNT_X
+				masterEnable = value & 0x80;
+				value &= 0x80; // Channel status bits are read only
+				break;
+		}
+		registers[offset - 0x60] = value;
+	}
+	else
+	{
+		logging::error("Write invalid sound register: " + helpers::intToHex(addr), "sound");
+	}
+}
+
+uint8_t sound::getRegister(uint32_t addr)
+{
+	uint32_t offset = addr - 0x4000000;
+	if (offset >= 0x60 && offset < 0xA0)
+	{
+		return registers[offset - 0x60];
+	}
+	return 0; // The FIFOs are write only
+}
+
+void sound::timerOverflow(int timerNum)
+{
+	if (!masterEnable)
+	{
+		return;
+	}
+	uint8_t controlHigh = registers[0x83 - 0x60];
+	if (((controlHigh >> 2) & 0x1) == timerNum)
+	{
+		drainFIFO(fifoA, fifoAAddr);
+	}
+	if (((controlHigh >> 6) & 0x1) == timerNum)
+	{
+		drainFIFO(fifoB, fifoBAddr);
+	}
+}
+
+void sound::drainFIFO(soundFIFO& fifo, uint32_t fifoAddr)
+{
+	fifo.currentSample = fifo.pop();
+	if (fifo.count <= fifoRefillLevel)
+	{
+		DMA->soundFIFORequest(fifoAddr);
+	}
+}
+
+void soundFIFO::reset()
+{
+	memset(samples, 0, sizeof(samples));
+	readPos = 0;
+	count = 0;
+	currentSample = 0;
+}
+
+void soundFIFO::push(uint8_t value)
+{
+	if (count == sizeof(samples))
+	{
+		return; // Full, the write is lost
+	}
+	samples[(readPos + count) % sizeof(samples)] = (int8_t)value;
+	count++;
+}
+
+int8_t soundFIFO::pop()
+{
+	if (count == 0)
+	{
+		return currentSample; // Empty, the last sample keeps playing
+	}
+	int8_t sample = samples[readPos];
+	readPos = (readPos + 1) % sizeof(samples);
+	count--;
+	return sample;
+}
\ No newline at end of file
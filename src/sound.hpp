@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include "dma.hpp"
+
+// One of the two 32 byte DirectSound sample queues
+struct soundFIFO
+{
+	int8_t samples[32];
+	int readPos;
+	int count;
+	int8_t currentSample; // The sample being output
+
+	void reset();
+	void push(uint8_t value);
+	int8_t pop();
+};
+
+/* There's no sound output yet. This only models enough of the sound hardware
+for games streaming audio to run properly: the DirectSound FIFOs, which are drained
+by timer overflows and refilled by DMA 1 and 2. The PSG registers are stored but not played. */
+class sound
+{
+	private:
+		dma* DMA;
+		uint8_t registers[0x40]; // 0x4000060 to 0x400009F
+		bool masterEnable;
+		soundFIFO fifoA;
+		soundFIFO fifoB;
+
+		void drainFIFO(soundFIFO& fifo, uint32_t fifoAddr);
+	public:
+		sound(dma* DMA);
+		void setRegister(uint32_t addr, uint8_t value);
+		uint8_t getRegister(uint32_t addr);
+		void timerOverflow(int timerNum);
+};
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "threadpool.hpp"
+
+threadPool::threadPool(int threadCount)
+{
+	currentTask = nullptr;
+	currentOwner = nullptr;
+	taskCount = 0;
+	nextTask = 0;
+	busyWorkers = 0;
+	generation = 0;
+	stopping = false;
+	for (int thread = 1; thread < threadCount; thread++)
+	{
+		workers.emplace_back(&threadPool::workerLoop, this, thread);
+	}
+}
+
+threadPool::~threadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	startSignal.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void threadPool::run(int taskCount, poolTask task, void* owner)
+{
+	if (workers.empty() || taskCount <= 1)
+	{
+		for (int i = 0; i < taskCount; i++)
+		{
+			task(owner, i, 0);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentTask = task;
+		currentOwner = owner;
+		this->taskCount = taskCount;
+		nextTask = 0;
+		busyWorkers = (int)workers.size();
+		generation++;
+	}
+	startSignal.notify_all();
+	runTasks(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	doneSignal.wait(lock, [this] { return busyWorkers == 0; });
+}
+
+void threadPool::workerLoop(int thread)
+{
+	uint64_t seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startSignal.wait(lock, [this, seenGeneration] { return stopping || generation != seenGeneration; });
+			if (stopping)
+			{
+				return;
+			}
+			seenGeneration = generation;
+		}
+		runTasks(thread);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers--;
+			if (busyWorkers == 0)
+			{
+				doneSignal.notify_one();
+			}
+		}
+	}
+}
+
+void threadPool::runTasks(int thread)
+{
+	int task;
+	while ((task = nextTask.fetch_add(1)) < taskCount)
+	{
+		currentTask(currentOwner, task, thread);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Runs one task. thread is 0 for the thread that called run, and 1 to getThreadCount() - 1 for the workers.
+typedef void (*poolTask)(void* owner, int task, int thread);
+
+/* A fixed set of worker threads for work that can be split up each frame, like drawing scanlines.
+run hands out tasks 0 to taskCount - 1 to the workers and the calling thread,
+then returns once they're all done. With a thread count of 1 everything runs on the caller. */
+class threadPool
+{
+	private:
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable startSignal;
+		std::condition_variable doneSignal;
+		poolTask currentTask;
+		void* currentOwner;
+		int taskCount;
+		std::atomic<int> nextTask;
+		int busyWorkers;
+		uint64_t generation; // Goes up with each run, so workers can tell there's new work
+		bool stopping;
+
+		void workerLoop(int thread);
+		void runTasks(int thread);
+	public:
+		threadPool(int threadCount);
+		~threadPool();
+		int getThreadCount() { return (int)workers.size() + 1; }
+		void run(int taskCount, poolTask task, void* owner);
+};
\ No newline at end of file
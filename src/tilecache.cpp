@@ -0,0 +1,79 @@
+#include "tilecache.hpp"
+#include "simd.hpp"
+#include <cstring>
+
+tileCache::tileCache(const uint8_t* vram)
+{
+	this->vram = vram;
+	memset(tiles, 0, sizeof(tiles));
+	memset(dirty, 0xFF, sizeof(dirty));
+	decodes = 0;
+}
+
+// Marks every tile overlapping VRAM [offset, offset + length) as needing a decode.
+void tileCache::invalidate(uint32_t offset, uint32_t length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+	int first = offset / 32;
+	int last = (offset + length - 1) / 32;
+	if (last >= tileCount)
+	{
+		last = tileCount - 1;
+	}
+	for (int tile = first; tile <= last; tile++)
+	{
+		dirty[tile / 64] |= (uint64_t)1 << (tile % 64);
+	}
+}
+
+// Returns one row of the 4bpp tile at tileAddr (a VRAM offset), pixel 0 in the lowest byte.
+// A miss means the tile changed since it was last read, and gets decoded here. Each thread's renderer has
+// its own copy of VRAM and its own cache, so every thread that reads a changed tile misses once.
+uint64_t tileCache::getRow(uint32_t tileAddr, int row, tileCacheStats& stats)
+{
+	int tile = tileAddr / 32;
+	uint64_t bit = (uint64_t)1 << (tile % 64);
+	if (dirty[tile / 64] & bit)
+	{
+		decode(tile);
+		dirty[tile / 64] &= ~bit;
+		stats.misses++;
+	}
+	else
+	{
+		stats.hits++;
+	}
+	uint64_t pixels;
+	memcpy(&pixels, &tiles[(tile * 64) + (row * 8)], sizeof(pixels));
+	return pixels;
+}
+
+void tileCache::decodeDirty()
+{
+	for (int group = 0; group < tileCount / 64; group++)
+	{
+		while (dirty[group] != 0)
+		{
+			uint32_t low = (uint32_t)dirty[group];
+			int bit = low ? cpuFeatures::countTrailingZeros(low) : 32 + cpuFeatures::countTrailingZeros((uint32_t)(dirty[group] >> 32));
+			decode((group * 64) + bit);
+			dirty[group] &= ~((uint64_t)1 << bit);
+		}
+	}
+}
+
+// Each byte of a 4bpp tile holds two pixels, the left one in the low nibble
+void tileCache::decode(int tile)
+{
+	const uint8_t* source = vram + (tile * 32);
+	uint8_t* dest = &tiles[tile * 64];
+	decodes++;
+	for (int i = 0; i < 32; i++)
+	{
+		dest[i * 2] = source[i] & 0xF;
+		dest[(i * 2) + 1] = source[i] >> 4;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+
+/* Keeps every 4bpp tile in VRAM expanded to one byte per pixel, so an 8 pixel row
+can be read with a single 64 bit load. Tiles are decoded the first time they're used
+after a write. gpu marks them dirty whenever its copy of VRAM changes.
+Each renderer has a cache of its own, so decoding on demand is safe on any thread.
+Affine sprites sample single pixels all over their tiles, so they read the
+decoded tiles directly after a decodeDirty.
+8bpp tiles are already one byte per pixel, so they're read straight from VRAM. */
+
+// Counts how getRow calls went. Each caller keeps its own, so threads don't share counters.
+struct tileCacheStats
+{
+	uint64_t hits; // The tile was already decoded
+	uint64_t misses; // The tile had to be decoded first
+};
+
+class tileCache
+{
+	private:
+		static constexpr int tileCount = 0x18000 / 32;
+		static constexpr int tilesPadding = 16; // The renderer's gathers read 4 bytes at a time, and can start on the last pixel
+
+		const uint8_t* vram;
+		uint8_t tiles[(tileCount * 64) + tilesPadding]; // Tile n's pixels start at n * 64
+		uint64_t dirty[tileCount / 64]; // One bit per tile
+		uint64_t decodes;
+
+		void decode(int tile);
+	public:
+		tileCache(const uint8_t* vram);
+		void invalidate(uint32_t offset, uint32_t length);
+		void decodeDirty();
+		uint64_t getRow(uint32_t tileAddr, int row, tileCacheStats& stats);
+		uint64_t getDecodes() { return decodes; }
+		// Tile n's 64 pixels start at n * 64. Only valid after decodeDirty.
+		const uint8_t* getDecodedTiles() { return tiles; }
+
+		// Mirrors a row of 8 one byte pixels
+		static uint64_t flipRow(uint64_t row)
+		{
+#ifdef _MSC_VER
+			return _byteswap_uint64(row);
+#else
+			return __builtin_bswap64(row);
+#endif
+		}
+};
\ No newline at end of file
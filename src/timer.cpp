@@ -2,21 +2,13 @@
 #include "logging.hpp"
 #include "helpers.hpp"
 
-timers::timers(interrupt* Interrupt)
+timers::timers(interrupt* Interrupt, scheduler* Scheduler, sound* Sound)
 {
 	this->Interrupt = Interrupt;
-	timer0.init(Interrupt, &timer1, 0);
-	timer1.init(Interrupt, &timer2, 1);
-	timer2.init(Interrupt, &timer3, 2);
-	timer3.init(Interrupt, nullptr, 3);
-}
-
-void timers::step(int cycles)
-{
-	timer0.step(cycles);
-	timer1.step(cycles);
-	timer2.step(cycles);
-	timer3.step(cycles);
+	timer0.init(Interrupt, Scheduler, Sound, &timer1, 0);
+	timer1.init(Interrupt, Scheduler, Sound, &timer2, 1);
+	timer2.init(Interrupt, Scheduler, Sound, &timer3, 2);
+	timer3.init(Interrupt, Scheduler, Sound, nullptr, 3);
 }
 
 void timers::setRegister(uint32_t addr, uint8_t value)
@@ -71,70 +63,123 @@ uint8_t timers::getRegister(uint32_t addr)
 	}
 }
 
-void timer::init(interrupt* Interrupt, timer* nextTimer, int timerNum)
+timer* timers::getTimer(int timerNum)
+{
+	switch (timerNum)
+	{
+		case 0: return &timer0;
+		case 1: return &timer1;
+		case 2: return &timer2;
+		default: return &timer3;
+	}
+}
+
+void timer::init(interrupt* Interrupt, scheduler* Scheduler, sound* Sound, timer* nextTimer, int timerNum)
 {
 	this->Interrupt = Interrupt;
+	this->Scheduler = Scheduler;
+	this->Sound = Sound;
 	this->nextTimer = nextTimer;
 	this->timerNum = timerNum;
 	reload = 0;
 	counter = 0;
+	startTime = 0;
 	prescaler = 0;
 	countUpTiming = false;
 	irqEnable = false;
 	timerStart = false;
-	prescalerCounter = 0;
+	Scheduler->setHandler(overflowEvent(), [](void* owner, uint64_t time) { static_cast<timer*>(owner)->overflow(time); }, this);
+}
+
+// True if the timer counts by itself, rather than being stopped or ticked by the previous timer.
+// Timer 0 has no previous timer, so it ignores count-up timing.
+bool timer::isCounting()
+{
+	return timerStart && (!countUpTiming || timerNum == 0);
 }
 
-void timer::step(int cycles)
+int timer::prescalerShift()
 {
-	if (timerStart && !countUpTiming)
+	switch (prescaler)
 	{
-		int prescalerSelection = 0;
-		switch (prescaler)
-		{
-			case 0: prescalerSelection = 1; break;
-			case 1: prescalerSelection = 64; break;
-			case 2: prescalerSelection = 256; break;
-			case 3: prescalerSelection = 1024; break;
-		}
-		prescalerCounter += cycles;
-		while (prescalerCounter >= prescalerSelection)
-		{
-			prescalerCounter -= prescalerSelection;
-			tick();
-		}
+		case 0: return 0; // 1 cycle
+		case 1: return 6; // 64 cycles
+		case 2: return 8; // 256 cycles
+		default: return 10; // 1024 cycles
 	}
 }
 
+eventType timer::overflowEvent()
+{
+	return (eventType)((int)eventType::Timer0Overflow + timerNum);
+}
+
+void timer::scheduleOverflow()
+{
+	if (isCounting())
+	{
+		uint64_t ticksLeft = 0x10000 - counter;
+		Scheduler->scheduleAt(overflowEvent(), startTime + (ticksLeft << prescalerShift()));
+	}
+	else
+	{
+		Scheduler->cancel(overflowEvent());
+	}
+}
+
+void timer::overflow(uint64_t time)
+{
+	counter = reload;
+	startTime = time;
+	overflowed();
+	scheduleOverflow();
+}
+
+// Ticks a count-up timer when the previous timer overflows
 void timer::tick()
 {
 	counter++;
 	if (counter == 0) // Counter overflowed
 	{
 		counter = reload;
-		if (irqEnable)
+		overflowed();
+	}
+}
+
+void timer::overflowed()
+{
+	if (irqEnable)
+	{
+		switch (timerNum)
 		{
-			switch (timerNum)
-			{
-				case 0: Interrupt->requestInterrupt(interruptType::Timer0); break;
-				case 1: Interrupt->requestInterrupt(interruptType::Timer1); break;
-				case 2: Interrupt->requestInterrupt(interruptType::Timer2); break;
-				case 3: Interrupt->requestInterrupt(interruptType::Timer3); break;
-			}
+			case 0: Interrupt->requestInterrupt(interruptType::Timer0); break;
+			case 1: Interrupt->requestInterrupt(interruptType::Timer1); break;
+			case 2: Interrupt->requestInterrupt(interruptType::Timer2); break;
+			case 3: Interrupt->requestInterrupt(interruptType::Timer3); break;
 		}
-		if (nextTimer != nullptr)
+	}
+	if (timerNum < 2)
+	{
+		// Timers 0 and 1 clock the DirectSound FIFOs
+		Sound->timerOverflow(timerNum);
+	}
+	if (nextTimer != nullptr)
+	{
+		if ((*nextTimer).countUpTiming && (*nextTimer).timerStart)
 		{
-			if ((*nextTimer).countUpTiming && (*nextTimer).timerStart)
-			{
-				nextTimer->tick();
-			}
+			nextTimer->tick();
 		}
 	}
 }
 
+// Only starting the timer restarts the prescaler. Any other control write keeps the
+// cycles already counted towards the next tick, as long as they're less than one tick at the new rate.
 void timer::setControl(uint8_t value)
 {
 	bool oldTimerStart = timerStart;
+	uint64_t now = Scheduler->getNow();
+	uint64_t phase = isCounting() ? (now - startTime) & ((1ull << prescalerShift()) - 1) : 0;
+	counter = getCounter();
 	prescaler = value & 0x3;
 	countUpTiming = value & 0x4;
 	irqEnable = value & 0x40;
@@ -142,8 +187,10 @@ void timer::setControl(uint8_t value)
 	if (!oldTimerStart && timerStart)
 	{
 		counter = reload;
+		phase = 0;
 	}
-	prescalerCounter = 0; // not sure what should happen with this?
+	startTime = now - (phase & ((1ull << prescalerShift()) - 1));
+	scheduleOverflow();
 }
 
 uint8_t timer::getControl()
@@ -167,10 +214,24 @@ void timer::setCounterHigh(uint8_t value)
 
 uint8_t timer::getCounterLow()
 {
-	return counter & 0xFF;
+	return getCounter() & 0xFF;
 }
 
 uint8_t timer::getCounterHigh()
 {
-	return counter >> 8;
+	return getCounter() >> 8;
+}
+
+void timer::setReload(uint16_t value)
+{
+	reload = value;
+}
+
+uint16_t timer::getCounter()
+{
+	if (isCounting())
+	{
+		return counter + ((Scheduler->getNow() - startTime) >> prescalerShift());
+	}
+	return counter;
 }
\ No newline at end of file
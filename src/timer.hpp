@@ -1,24 +1,36 @@
 #pragma once
 #include "interrupt.hpp"
+#include "scheduler.hpp"
+#include "sound.hpp"
 
+/* A running timer isn't stepped. It keeps the counter value it had at startTime,
+and the current value is worked out from the cycle clock when it's read.
+The only real work is the overflow event, which also ticks count-up timers. */
 class timer
 {
 	private:
 		interrupt* Interrupt;
+		scheduler* Scheduler;
+		sound* Sound;
 		timer* nextTimer;
 		int timerNum;
 
 		uint16_t reload;
-		uint16_t counter;
+		uint16_t counter; // Value at startTime
+		uint64_t startTime;
 		uint8_t prescaler;
 		bool countUpTiming;
 		bool irqEnable;
 		bool timerStart;
 
-		int prescalerCounter;
+		bool isCounting();
+		int prescalerShift();
+		eventType overflowEvent();
+		void scheduleOverflow();
+		void overflowed();
 	public:
-		void init(interrupt* Interrupt, timer* nextTimer, int timerNum);
-		void step(int cycles);
+		void init(interrupt* Interrupt, scheduler* Scheduler, sound* Sound, timer* nextTimer, int timerNum);
+		void overflow(uint64_t time);
 		void tick();
 		void setControl(uint8_t value);
 		uint8_t getControl();
@@ -26,6 +38,8 @@ class timer
 		void setCounterHigh(uint8_t value);
 		uint8_t getCounterLow();
 		uint8_t getCounterHigh();
+		void setReload(uint16_t value);
+		uint16_t getCounter();
 };
 
 class timers
@@ -37,8 +51,8 @@ class timers
 		timer timer2;
 		timer timer3;
 	public:
-		timers(interrupt* Interrupt);
-		void step(int cycles);
+		timers(interrupt* Interrupt, scheduler* Scheduler, sound* Sound);
 		void setRegister(uint32_t addr, uint8_t value);
 		uint8_t getRegister(uint32_t addr);
+		timer* getTimer(int timerNum);
 };
\ No newline at end of file
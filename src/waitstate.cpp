@@ -0,0 +1,233 @@
+#include "waitstate.hpp"
+#include "logging.hpp"
+#include "helpers.hpp"
+
+/*4000204h - WAITCNT - Waitstate Control (R/W)
+  Bit   Expl.
+  0-1   SRAM Wait Control          (0..3 = 4,3,2,8 cycles)
+  2-3   Wait State 0 First Access  (0..3 = 4,3,2,8 cycles)
+  4     Wait State 0 Second Access (0..1 = 2,1 cycles)
+  5-6   Wait State 1 First Access  (0..3 = 4,3,2,8 cycles)
+  7     Wait State 1 Second Access (0..1 = 4,1 cycles)
+  8-9   Wait State 2 First Access  (0..3 = 4,3,2,8 cycles)
+  10    Wait State 2 Second Access (0..1 = 8,1 cycles)
+  11-12 PHI Terminal Output        (not emulated)
+  13    Not used
+  14    Game Pak Prefetch Buffer   (0=Disable, 1=Enable)
+  15    Game Pak Type Flag         (Read Only) (0=GBA, 1=CGB)
+
+The cycle counts above are waitstates, on top of the 1 cycle every access takes.
+The GamePak bus is 16 bits wide, so a 32 bit ROM access is a first access
+followed by a sequential second access.
+
+When the prefetch buffer is enabled, the GamePak keeps reading opcodes ahead of
+the CPU (up to 8 halfwords) whenever the CPU isn't using the GamePak bus itself.
+Sequential opcode fetches that hit the buffer then only take 1 cycle per halfword.*/
+
+constexpr int firstAccessWaits[4] = { 4, 3, 2, 8 };
+constexpr int ws0SecondAccessWaits[2] = { 2, 1 };
+constexpr int ws1SecondAccessWaits[2] = { 4, 1 };
+constexpr int ws2SecondAccessWaits[2] = { 8, 1 };
+constexpr int prefetchBufferSize = 8;
+
+static bool isROMRegion(uint32_t addr)
+{
+	return addr >= 0x08000000 && addr < 0x0E000000;
+}
+
+waitstate::waitstate()
+{
+	nextSeqAddr = 0;
+	prefetchHead = 0;
+	prefetchCount = 0;
+	prefetchProgress = 0;
+	prefetchEnable = false;
+	setControl(0);
+}
+
+void waitstate::updateTables()
+{
+	for (int region = 0; region < 16; region++)
+	{
+		for (int width = width8; width <= width32; width++)
+		{
+			nonSeqCycles[region][width] = 1;
+			seqCycles[region][width] = 1;
+		}
+	}
+	// EWRAM has a 16 bit bus and 2 waitstates
+	nonSeqCycles[0x2][width8] = seqCycles[0x2][width8] = 3;
+	nonSeqCycles[0x2][width16] = seqCycles[0x2][width16] = 3;
+	nonSeqCycles[0x2][width32] = seqCycles[0x2][width32] = 6;
+	// Palette RAM and VRAM have a 16 bit bus
+	nonSeqCycles[0x5][width32] = seqCycles[0x5][width32] = 2;
+	nonSeqCycles[0x6][width32] = seqCycles[0x6][width32] = 2;
+
+	int romFirst[3] = {
+		firstAccessWaits[(control >> 2) & 0x3],
+		firstAccessWaits[(control >> 5) & 0x3],
+		firstAccessWaits[(control >> 8) & 0x3]
+	};
+	int romSecond[3] = {
+		ws0SecondAccessWaits[(control >> 4) & 0x1],
+		ws1SecondAccessWaits[(control >> 7) & 0x1],
+		ws2SecondAccessWaits[(control >> 10) & 0x1]
+	};
+	for (int ws = 0; ws < 3; ws++)
+	{
+		int n = 1 + romFirst[ws];
+		int s = 1 + romSecond[ws];
+		for (int region = 0x8 + (ws * 2); region < 0xA + (ws * 2); region++)
+		{
+			nonSeqCycles[region][width8] = n;
+			nonSeqCycles[region][width16] = n;
+			nonSeqCycles[region][width32] = n + s;
+			seqCycles[region][width8] = s;
+			seqCycles[region][width16] = s;
+			seqCycles[region][width32] = s * 2;
+		}
+	}
+
+	// SRAM has an 8 bit bus, wider accesses aren't really supported
+	int sram = 1 + firstAccessWaits[control & 0x3];
+	for (int region = 0xE; region < 0x10; region++)
+	{
+		for (int width = width8; width <= width32; width++)
+		{
+			nonSeqCycles[region][width] = sram;
+			seqCycles[region][width] = sram;
+		}
+	}
+}
+
+void waitstate::setControl(uint16_t value)
+{
+	control = value & 0x5FFF;
+	bool oldPrefetchEnable = prefetchEnable;
+	prefetchEnable = control & 0x4000;
+	if (oldPrefetchEnable != prefetchEnable)
+	{
+		prefetchCount = 0;
+		prefetchProgress = 0;
+	}
+	updateTables();
+}
+
+uint16_t waitstate::getControl()
+{
+	return control;
+}
+
+void waitstate::setRegister(uint32_t addr, uint8_t value)
+{
+	switch (addr - 0x4000000)
+	{
+		case 0x204: setControl((control & 0xFF00) | value); break;
+		case 0x205: setControl((control & 0x00FF) | ((uint16_t)value << 8)); break;
+		case 0x206: case 0x207: break; // Unused
+		default:
+			logging::error("Write invalid waitstate register: " + helpers::intToHex(addr), "waitstate");
+			break;
+	}
+}
+
+uint8_t waitstate::getRegister(uint32_t addr)
+{
+	switch (addr - 0x4000000)
+	{
+		case 0x204: return control & 0xFF;
+		case 0x205: return control >> 8;
+		case 0x206: case 0x207: return 0; // Unused
+		default:
+			logging::error("Read invalid waitstate register: " + helpers::intToHex(addr), "waitstate");
+			return 0;
+	}
+}
+
+int waitstate::accessCycles(uint32_t addr, int width, bool sequential)
+{
+	int region = (addr >> 24) & 0xF;
+	if (addr >= 0x10000000)
+	{
+		return 1;
+	}
+	return sequential ? seqCycles[region][width] : nonSeqCycles[region][width];
+}
+
+void waitstate::runPrefetch(int cycles)
+{
+	// The GamePak bus is free while the CPU is busy elsewhere, so the prefetcher fills the buffer.
+	if (!prefetchEnable || !isROMRegion(prefetchHead) || prefetchCount >= prefetchBufferSize)
+	{
+		return;
+	}
+	int halfwordCycles = seqCycles[(prefetchHead >> 24) & 0xF][width16];
+	prefetchProgress += cycles;
+	while (prefetchProgress >= halfwordCycles && prefetchCount < prefetchBufferSize)
+	{
+		prefetchProgress -= halfwordCycles;
+		prefetchCount++;
+	}
+	if (prefetchCount >= prefetchBufferSize)
+	{
+		prefetchProgress = 0;
+	}
+}
+
+int waitstate::dataAccess(uint32_t addr, int width)
+{
+	// Crossing a 128KB boundary in ROM always starts a new burst
+	bool sequential = (addr == nextSeqAddr) && !(isROMRegion(addr) && (addr & 0x1FFFF) == 0);
+	int cycles = accessCycles(addr, width, sequential);
+	nextSeqAddr = addr + (1 << width);
+	if (isROMRegion(addr))
+	{
+		// A data access to ROM takes over the GamePak bus and throws away the buffer
+		prefetchHead = 0;
+		prefetchCount = 0;
+		prefetchProgress = 0;
+	}
+	else
+	{
+		runPrefetch(cycles);
+	}
+	return cycles;
+}
+
+int waitstate::opcodeFetch(uint32_t addr, int width)
+{
+	if (!prefetchEnable || !isROMRegion(addr))
+	{
+		return dataAccess(addr, width);
+	}
+	int halfwords = (width == width32) ? 2 : 1;
+	int cycles;
+	if (addr == prefetchHead && prefetchCount >= halfwords)
+	{
+		// Buffer hit
+		cycles = halfwords;
+		prefetchCount -= halfwords;
+		prefetchHead += halfwords * 2;
+		runPrefetch(cycles);
+	}
+	else if (addr == prefetchHead)
+	{
+		// The opcode is still being fetched, wait for the rest of it
+		int halfwordCycles = seqCycles[(addr >> 24) & 0xF][width16];
+		cycles = prefetchCount + ((halfwords - prefetchCount) * halfwordCycles) - prefetchProgress;
+		prefetchCount = 0;
+		prefetchProgress = 0;
+		prefetchHead += halfwords * 2;
+	}
+	else
+	{
+		// Miss, so fetch normally and restart the prefetcher after this opcode
+		bool sequential = (addr == nextSeqAddr) && (addr & 0x1FFFF) != 0;
+		cycles = accessCycles(addr, width, sequential);
+		prefetchHead = addr + (halfwords * 2);
+		prefetchCount = 0;
+		prefetchProgress = 0;
+	}
+	nextSeqAddr = addr + (1 << width);
+	return cycles;
+}
\ No newline at end of file
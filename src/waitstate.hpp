@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+// Access widths, used to index the cycle tables.
+constexpr int width8 = 0;
+constexpr int width16 = 1;
+constexpr int width32 = 2;
+
+class waitstate
+{
+	private:
+		uint16_t control; // WAITCNT
+		bool prefetchEnable;
+		// Cycles taken by an access, indexed by [addr >> 24][width]
+		uint8_t nonSeqCycles[16][3];
+		uint8_t seqCycles[16][3];
+
+		uint32_t nextSeqAddr;
+		uint32_t prefetchHead; // Address of the first halfword in the prefetch buffer
+		int prefetchCount; // Number of halfwords in the buffer
+		int prefetchProgress; // Cycles spent so far fetching the next halfword
+
+		void updateTables();
+		void runPrefetch(int cycles);
+	public:
+		waitstate();
+		void setControl(uint16_t value);
+		uint16_t getControl();
+		void setRegister(uint32_t addr, uint8_t value);
+		uint8_t getRegister(uint32_t addr);
+		int accessCycles(uint32_t addr, int width, bool sequential);
+		int dataAccess(uint32_t addr, int width);
+		int opcodeFetch(uint32_t addr, int width);
+};
\ No newline at end of file